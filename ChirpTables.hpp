@@ -0,0 +1,116 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <Pothos/Config.hpp>
+#include <complex>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <cmath>
+
+/*!
+ * Immutable chirp tables for one spread factor and oversampling ratio.
+ * The tables are shared by every modulator and demodulator in the process,
+ * use getChirpTables() rather than constructing them directly.
+ */
+struct ChirpTables
+{
+    ChirpTables(const size_t sf, const size_t ovs):
+        sf(sf),
+        N(1 << sf),
+        ovs(ovs),
+        NN(N*ovs)
+    {
+        //chip rate dechirp tables for the demodulator
+        float phase = -M_PI;
+        double phaseAccum = 0.0;
+        for (size_t i = 0; i < N; i++)
+        {
+            phaseAccum += phase;
+            auto entry = std::polar(1.0, phaseAccum);
+            up.push_back(std::complex<float>(std::conj(entry)));
+            down.push_back(std::complex<float>(entry));
+            phase += (2*M_PI)/N;
+        }
+
+        //oversampled base upchirp for the modulator, over two periods
+        //so that the chirp of any symbol is a contiguous slice of the table,
+        //the frequency sweeps from -pi/ovs to pi/ovs and wraps every NN samples
+        const double fMin = -M_PI/ovs;
+        const double fStep = (2*M_PI)/(N*ovs*ovs);
+        modPhase.resize(2*NN+1);
+        modChirp.resize(2*NN+1);
+        modPhase[0] = 0.0;
+        modChirp[0] = 1.0f;
+        for (size_t i = 0; i < 2*NN; i++)
+        {
+            const double f = fMin + ((i+1) % NN)*fStep;
+            modPhase[i+1] = modPhase[i] + f;
+            modChirp[i+1] = std::complex<float>(std::polar(1.0, modPhase[i+1]));
+        }
+    }
+
+    const size_t sf;
+    const size_t N;
+    const size_t ovs;
+    const size_t NN;
+
+    //! chip rate up and down chirps to dechirp a received symbol, N entries
+    std::vector<std::complex<float>> up, down;
+
+    //! phase of the oversampled base upchirp after i samples, 2*NN+1 entries
+    std::vector<double> modPhase;
+
+    //! the oversampled base upchirp exp(j*modPhase[i]), 2*NN+1 entries
+    std::vector<std::complex<float>> modChirp;
+
+    /*!
+     * Generate a chirp from the tables, the table driven equivalent of genChirp().
+     * \param [out] samps pointer to the output samples
+     * \param shift the starting offset into the base chirp in samples (symbol*ovs)
+     * \param num the number of samples to generate, at most NN
+     * \param down true for downchirp, false for up
+     * \param ampl the chirp amplitude
+     * \param [inout] phaseAccum running phase accumulator value
+     * \return the number of samples generated
+     */
+    size_t genChirp(std::complex<float> *samps, const size_t shift, const size_t num,
+        const bool down, const float ampl, float &phaseAccum) const
+    {
+        const size_t so = shift % NN;
+        const auto chirp = modChirp.data() + so + 1;
+        const double phase0 = down?(phaseAccum + modPhase[so]):(phaseAccum - modPhase[so]);
+        const auto start = std::polar(double(ampl), phase0);
+        const std::complex<float> scale(start);
+        if (down) for (size_t i = 0; i < num; i++) samps[i] = scale*std::conj(chirp[i]);
+        else for (size_t i = 0; i < num; i++) samps[i] = scale*chirp[i];
+
+        const double delta = modPhase[so+num] - modPhase[so];
+        double accum = down?(phaseAccum - delta):(phaseAccum + delta);
+        accum -= std::floor(accum/(2*M_PI))*2*M_PI;
+        phaseAccum = float(accum);
+        return num;
+    }
+};
+
+/*!
+ * Get the shared chirp tables for a spread factor and oversampling ratio.
+ * The cache only holds weak references: the tables are built on first use
+ * and freed when the last block using them releases its reference.
+ */
+inline std::shared_ptr<const ChirpTables> getChirpTables(const size_t sf, const size_t ovs)
+{
+    static std::mutex mutex;
+    static std::map<std::pair<size_t, size_t>, std::weak_ptr<const ChirpTables>> cache;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &entry = cache[std::make_pair(sf, ovs)];
+    auto tables = entry.lock();
+    if (not tables)
+    {
+        tables = std::make_shared<const ChirpTables>(sf, ovs);
+        entry = tables;
+    }
+    return tables;
+}
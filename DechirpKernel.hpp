@@ -0,0 +1,309 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <Pothos/Config.hpp>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DECHIRP_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/*!
+ * Signature of a dechirp kernel:
+ * out[i] = in[i] * chirp[i] * phasor, phasor *= rotation
+ * The fine frequency correction is a recursive phase rotator,
+ * the phasor is renormalized to unit magnitude after each call.
+ * Integer input samples are converted to float in the same pass,
+ * scaled so that the full scale of the integer type maps to 1.0.
+ * \tparam InType the input sample scalar: float, int16_t, or int8_t
+ * \param in pointer to the input samples
+ * \param chirp pointer to the local chirp table
+ * \param [inout] phasor running fine frequency correction phasor
+ * \param rotation the unit magnitude phase advance per sample
+ * \param [out] out pointer to the dechirped samples
+ * \param n the number of samples to process
+ */
+template <typename InType>
+using DechirpKernel = void (*)(
+    const std::complex<InType> *in,
+    const std::complex<float> *chirp,
+    std::complex<float> &phasor,
+    const std::complex<float> &rotation,
+    std::complex<float> *out, const size_t n);
+
+//! The scale factor which maps the full scale of an input type to 1.0
+template <typename InType> static inline float dechirpScale(void) {return 1.0f;}
+template <> inline float dechirpScale<int16_t>(void) {return 1.0f/32768;}
+template <> inline float dechirpScale<int8_t>(void) {return 1.0f/128;}
+
+//! Convert an input sample to float without scaling
+template <typename InType>
+static inline std::complex<float> dechirpLoad(const std::complex<InType> &x)
+{
+    return std::complex<float>(float(x.real()), float(x.imag()));
+}
+
+//! Complex multiply without the inf/nan recovery of std::complex
+static inline std::complex<float> dechirpMul(const std::complex<float> &a, const std::complex<float> &b)
+{
+    return std::complex<float>(
+        a.real()*b.real() - a.imag()*b.imag(),
+        a.imag()*b.real() + a.real()*b.imag());
+}
+
+//! Portable dechirp kernel, one sample at a time
+//! The input scale is folded into the phasor, the final renormalization removes it.
+template <typename InType>
+static inline void dechirpScalar(
+    const std::complex<InType> *in,
+    const std::complex<float> *chirp,
+    std::complex<float> &phasor,
+    const std::complex<float> &rotation,
+    std::complex<float> *out, const size_t n)
+{
+    auto p = phasor*dechirpScale<InType>();
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i] = dechirpMul(dechirpMul(dechirpLoad(in[i]), chirp[i]), p);
+        p = dechirpMul(p, rotation);
+    }
+    phasor = p/std::abs(p);
+}
+
+#ifdef DECHIRP_X86_DISPATCH
+
+//! Interleaved complex multiply, two samples per register
+__attribute__((target("sse3")))
+static inline __m128 dechirpMulSse3(const __m128 a, const __m128 b)
+{
+    const __m128 t1 = _mm_mul_ps(a, _mm_moveldup_ps(b));
+    const __m128 t2 = _mm_mul_ps(_mm_shuffle_ps(a, a, 0xB1), _mm_movehdup_ps(b));
+    return _mm_addsub_ps(t1, t2);
+}
+
+//! Load two input samples as interleaved floats
+__attribute__((target("sse3")))
+static inline __m128 dechirpLoadSse3(const std::complex<float> *in)
+{
+    return _mm_loadu_ps(reinterpret_cast<const float *>(in));
+}
+
+__attribute__((target("sse3")))
+static inline __m128 dechirpLoadSse3(const std::complex<int16_t> *in)
+{
+    const __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in));
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+}
+
+__attribute__((target("sse3")))
+static inline __m128 dechirpLoadSse3(const std::complex<int8_t> *in)
+{
+    int32_t word; std::memcpy(&word, in, sizeof(word));
+    __m128i x = _mm_cvtsi32_si128(word);
+    x = _mm_unpacklo_epi8(x, x);
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 24));
+}
+
+//! SSE3 dechirp kernel, two samples per iteration with two rotator lanes
+template <typename InType>
+__attribute__((target("sse3")))
+static inline void dechirpSse3(
+    const std::complex<InType> *in,
+    const std::complex<float> *chirp,
+    std::complex<float> &phasor,
+    const std::complex<float> &rotation,
+    std::complex<float> *out, const size_t n)
+{
+    const auto r1 = phasor*dechirpScale<InType>();
+    const auto r2 = dechirpMul(r1, rotation);
+    const auto rot2 = dechirpMul(rotation, rotation);
+    __m128 p = _mm_setr_ps(r1.real(), r1.imag(), r2.real(), r2.imag());
+    const __m128 step = _mm_setr_ps(rot2.real(), rot2.imag(), rot2.real(), rot2.imag());
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        const __m128 x = dechirpLoadSse3(in + i);
+        const __m128 c = _mm_loadu_ps(reinterpret_cast<const float *>(chirp + i));
+        _mm_storeu_ps(reinterpret_cast<float *>(out + i), dechirpMulSse3(dechirpMulSse3(x, c), p));
+        p = dechirpMulSse3(p, step);
+    }
+    _mm_storel_pi(reinterpret_cast<__m64 *>(&phasor), p);
+    phasor /= dechirpScale<InType>();
+    dechirpScalar(in + i, chirp + i, phasor, rotation, out + i, n - i);
+}
+
+//! Interleaved complex multiply, four samples per register
+__attribute__((target("avx2")))
+static inline __m256 dechirpMulAvx2(const __m256 a, const __m256 b)
+{
+    const __m256 t1 = _mm256_mul_ps(a, _mm256_moveldup_ps(b));
+    const __m256 t2 = _mm256_mul_ps(_mm256_permute_ps(a, 0xB1), _mm256_movehdup_ps(b));
+    return _mm256_addsub_ps(t1, t2);
+}
+
+//! Load four input samples as interleaved floats
+__attribute__((target("avx2")))
+static inline __m256 dechirpLoadAvx2(const std::complex<float> *in)
+{
+    return _mm256_loadu_ps(reinterpret_cast<const float *>(in));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 dechirpLoadAvx2(const std::complex<int16_t> *in)
+{
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+    return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(x));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 dechirpLoadAvx2(const std::complex<int8_t> *in)
+{
+    const __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in));
+    return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(x));
+}
+
+//! AVX2 dechirp kernel, four samples per iteration with four rotator lanes
+template <typename InType>
+__attribute__((target("avx2")))
+static inline void dechirpAvx2(
+    const std::complex<InType> *in,
+    const std::complex<float> *chirp,
+    std::complex<float> &phasor,
+    const std::complex<float> &rotation,
+    std::complex<float> *out, const size_t n)
+{
+    const auto r1 = phasor*dechirpScale<InType>();
+    const auto r2 = dechirpMul(r1, rotation);
+    const auto r3 = dechirpMul(r2, rotation);
+    const auto r4 = dechirpMul(r3, rotation);
+    const auto rot2 = dechirpMul(rotation, rotation);
+    const auto rot4 = dechirpMul(rot2, rot2);
+    __m256 p = _mm256_setr_ps(r1.real(), r1.imag(), r2.real(), r2.imag(), r3.real(), r3.imag(), r4.real(), r4.imag());
+    const __m256 step = _mm256_setr_ps(rot4.real(), rot4.imag(), rot4.real(), rot4.imag(), rot4.real(), rot4.imag(), rot4.real(), rot4.imag());
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m256 x = dechirpLoadAvx2(in + i);
+        const __m256 c = _mm256_loadu_ps(reinterpret_cast<const float *>(chirp + i));
+        _mm256_storeu_ps(reinterpret_cast<float *>(out + i), dechirpMulAvx2(dechirpMulAvx2(x, c), p));
+        p = dechirpMulAvx2(p, step);
+    }
+    _mm_storel_pi(reinterpret_cast<__m64 *>(&phasor), _mm256_castps256_ps128(p));
+    phasor /= dechirpScale<InType>();
+    dechirpScalar(in + i, chirp + i, phasor, rotation, out + i, n - i);
+}
+
+//! AVX2 dechirp kernel for exactly 2^LOG2N samples, n is ignored.
+//! Two independent rotator chains of four lanes step eight samples at a time,
+//! which hides the latency of the rotator multiply that bounds dechirpAvx2().
+template <typename InType, size_t LOG2N>
+__attribute__((target("avx2")))
+static inline void dechirpAvx2Sized(
+    const std::complex<InType> *in,
+    const std::complex<float> *chirp,
+    std::complex<float> &phasor,
+    const std::complex<float> &rotation,
+    std::complex<float> *out, const size_t)
+{
+    const size_t N = size_t(1) << LOG2N;
+    std::complex<float> r[8];
+    r[0] = phasor*dechirpScale<InType>();
+    for (size_t k = 1; k < 8; k++) r[k] = dechirpMul(r[k-1], rotation);
+    const auto rot2 = dechirpMul(rotation, rotation);
+    const auto rot4 = dechirpMul(rot2, rot2);
+    const auto rot8 = dechirpMul(rot4, rot4);
+    __m256 p0 = _mm256_loadu_ps(reinterpret_cast<const float *>(r));
+    __m256 p1 = _mm256_loadu_ps(reinterpret_cast<const float *>(r + 4));
+    const __m256 step = _mm256_setr_ps(rot8.real(), rot8.imag(), rot8.real(), rot8.imag(), rot8.real(), rot8.imag(), rot8.real(), rot8.imag());
+    for (size_t i = 0; i < N; i += 8)
+    {
+        const __m256 x0 = dechirpLoadAvx2(in + i);
+        const __m256 x1 = dechirpLoadAvx2(in + i + 4);
+        const __m256 c0 = _mm256_loadu_ps(reinterpret_cast<const float *>(chirp + i));
+        const __m256 c1 = _mm256_loadu_ps(reinterpret_cast<const float *>(chirp + i + 4));
+        _mm256_storeu_ps(reinterpret_cast<float *>(out + i), dechirpMulAvx2(dechirpMulAvx2(x0, c0), p0));
+        _mm256_storeu_ps(reinterpret_cast<float *>(out + i + 4), dechirpMulAvx2(dechirpMulAvx2(x1, c1), p1));
+        p0 = dechirpMulAvx2(p0, step);
+        p1 = dechirpMulAvx2(p1, step);
+    }
+    _mm_storel_pi(reinterpret_cast<__m64 *>(&phasor), _mm256_castps256_ps128(p0));
+    phasor /= std::abs(phasor);
+}
+
+#endif //DECHIRP_X86_DISPATCH
+
+/*!
+ * Fused decimate and dechirp for an oversampled input:
+ * Each chip is the average of ovs consecutive input samples,
+ * which is then dechirped and rotated once per chip.
+ * Averaging before the dechirp keeps the folded segments of a chirp
+ * coherent, so both segments of a symbol land in the same FFT bin.
+ * \param n the number of chips, n*ovs input samples are read
+ * \param ovs the oversampling ratio of the input
+ */
+template <typename InType>
+static inline void dechirpDecimate(
+    const std::complex<InType> *in,
+    const std::complex<float> *chirp,
+    std::complex<float> &phasor,
+    const std::complex<float> &rotation,
+    std::complex<float> *out, const size_t n, const size_t ovs)
+{
+    const float scale = 1.0f/ovs;
+    auto p = phasor*dechirpScale<InType>();
+    for (size_t i = 0; i < n; i++)
+    {
+        std::complex<float> acc(0.0f);
+        for (size_t k = 0; k < ovs; k++) acc += dechirpLoad(*in++);
+        out[i] = dechirpMul(dechirpMul(acc*scale, chirp[i]), p);
+        p = dechirpMul(p, rotation);
+    }
+    phasor = p/std::abs(p);
+}
+
+/*!
+ * Select the fastest dechirp kernel supported by the running CPU.
+ * The vector kernels advance the rotator in strides of 2 or 4 samples,
+ * so results match the scalar kernel to within float rounding.
+ */
+template <typename InType = float>
+static inline DechirpKernel<InType> getDechirpKernel(void)
+{
+    #ifdef DECHIRP_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return &dechirpAvx2<InType>;
+    if (__builtin_cpu_supports("sse3")) return &dechirpSse3<InType>;
+    #endif //DECHIRP_X86_DISPATCH
+    return &dechirpScalar<InType>;
+}
+
+/*!
+ * Select the dechirp kernel for symbols of exactly N samples.
+ * With AVX2, the LoRa sizes SF7 to SF12 dispatch to a kernel instance
+ * compiled for that size, other sizes use the kernel from getDechirpKernel().
+ */
+template <typename InType>
+static inline DechirpKernel<InType> getDechirpKernel(const size_t N)
+{
+    #ifdef DECHIRP_X86_DISPATCH
+    static const DechirpKernel<InType> sized[] = {
+        &dechirpAvx2Sized<InType, 7>,
+        &dechirpAvx2Sized<InType, 8>,
+        &dechirpAvx2Sized<InType, 9>,
+        &dechirpAvx2Sized<InType, 10>,
+        &dechirpAvx2Sized<InType, 11>,
+        &dechirpAvx2Sized<InType, 12>,
+    };
+    __builtin_cpu_init();
+    for (size_t log2N = 7; log2N <= 12 and __builtin_cpu_supports("avx2"); log2N++)
+    {
+        if (N == (size_t(1) << log2N)) return sized[log2N-7];
+    }
+    #endif //DECHIRP_X86_DISPATCH
+    return getDechirpKernel<InType>();
+}
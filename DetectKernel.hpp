@@ -0,0 +1,275 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <Pothos/Config.hpp>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DETECT_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/*!
+ * Signature of a detect kernel:
+ * Find the bin with the largest squared magnitude |X[i]|^2
+ * and the total squared magnitude over all N bins.
+ * Ties resolve to the lowest bin index like a sequential scan.
+ * \param in pointer to the FFT output bins
+ * \param N the number of bins
+ * \param [out] maxValue the squared magnitude of the largest bin
+ * \param [out] total the sum of the squared magnitudes
+ * \return the index of the largest bin
+ */
+template <typename Type>
+using DetectKernel = size_t (*)(
+    const std::complex<Type> *in, const size_t N,
+    Type &maxValue, double &total);
+
+//! Portable detect kernel, one bin at a time with a double accumulator
+template <typename Type>
+static inline size_t detectScalar(
+    const std::complex<Type> *in, const size_t N,
+    Type &maxValue, double &total)
+{
+    size_t maxIndex = 0;
+    maxValue = 0;
+    total = 0;
+    for (size_t i = 0; i < N; i++)
+    {
+        auto re = in[i].real();
+        auto im = in[i].imag();
+        auto mag2 = re*re + im*im;
+        total += mag2;
+        if (mag2 > maxValue)
+        {
+            maxIndex = i;
+            maxValue = mag2;
+        }
+    }
+    return maxIndex;
+}
+
+//! Finish a lane-wise reduction: largest value, then lowest index on a tie,
+//! and a double precision sum of the compensated lane totals
+static inline size_t detectReduce(
+    const float *maxs, const int32_t *idxs, const float *sums, const float *comps, const size_t lanes,
+    float &maxValue, double &total)
+{
+    size_t maxIndex = 0;
+    maxValue = 0;
+    total = 0;
+    for (size_t j = 0; j < lanes; j++)
+    {
+        total += double(sums[j]) - double(comps[j]);
+        if (maxs[j] > maxValue or (maxs[j] == maxValue and maxs[j] > 0 and size_t(idxs[j]) < maxIndex))
+        {
+            maxValue = maxs[j];
+            maxIndex = idxs[j];
+        }
+    }
+    return maxIndex;
+}
+
+//! Scan the bins that do not fill a vector, continuing a reduction
+static inline size_t detectTail(
+    const std::complex<float> *in, size_t i, const size_t N,
+    size_t maxIndex, float &maxValue, double &total)
+{
+    for (; i < N; i++)
+    {
+        const float mag2 = in[i].real()*in[i].real() + in[i].imag()*in[i].imag();
+        total += mag2;
+        if (mag2 > maxValue)
+        {
+            maxIndex = i;
+            maxValue = mag2;
+        }
+    }
+    return maxIndex;
+}
+
+#ifdef DETECT_X86_DISPATCH
+
+//! SSE3 detect kernel, four bins per iteration in four lanes
+//! The lane totals are float with Kahan compensation.
+__attribute__((target("sse3")))
+static inline size_t detectSse3(
+    const std::complex<float> *in, const size_t N,
+    float &maxValue, double &total)
+{
+    const float *p = reinterpret_cast<const float *>(in);
+    __m128 maxv = _mm_setzero_ps();
+    __m128i maxi = _mm_setzero_si128();
+    __m128i idx = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i step = _mm_set1_epi32(4);
+    __m128 sum = _mm_setzero_ps();
+    __m128 comp = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= N; i += 4)
+    {
+        const __m128 a = _mm_loadu_ps(p + 2*i);
+        const __m128 b = _mm_loadu_ps(p + 2*i + 4);
+        const __m128 mag2 = _mm_hadd_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b));
+        const __m128 y = _mm_sub_ps(mag2, comp);
+        const __m128 t = _mm_add_ps(sum, y);
+        comp = _mm_sub_ps(_mm_sub_ps(t, sum), y);
+        sum = t;
+        const __m128 gt = _mm_cmpgt_ps(mag2, maxv);
+        maxv = _mm_or_ps(_mm_and_ps(gt, mag2), _mm_andnot_ps(gt, maxv));
+        maxi = _mm_or_si128(_mm_and_si128(_mm_castps_si128(gt), idx), _mm_andnot_si128(_mm_castps_si128(gt), maxi));
+        idx = _mm_add_epi32(idx, step);
+    }
+    float maxs[4], sums[4], comps[4];
+    int32_t idxs[4];
+    _mm_storeu_ps(maxs, maxv);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(idxs), maxi);
+    _mm_storeu_ps(sums, sum);
+    _mm_storeu_ps(comps, comp);
+    const size_t maxIndex = detectReduce(maxs, idxs, sums, comps, 4, maxValue, total);
+    return detectTail(in, i, N, maxIndex, maxValue, total);
+}
+
+//! AVX2 detect kernel, eight bins per iteration in eight lanes
+//! The horizontal add interleaves the bins across the 128-bit halves,
+//! so the lane indexes step through 0, 1, 4, 5 and 2, 3, 6, 7.
+__attribute__((target("avx2")))
+static inline size_t detectAvx2(
+    const std::complex<float> *in, const size_t N,
+    float &maxValue, double &total)
+{
+    const float *p = reinterpret_cast<const float *>(in);
+    __m256 maxv = _mm256_setzero_ps();
+    __m256i maxi = _mm256_setzero_si256();
+    __m256i idx = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+    const __m256i step = _mm256_set1_epi32(8);
+    __m256 sum = _mm256_setzero_ps();
+    __m256 comp = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= N; i += 8)
+    {
+        const __m256 a = _mm256_loadu_ps(p + 2*i);
+        const __m256 b = _mm256_loadu_ps(p + 2*i + 8);
+        const __m256 mag2 = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+        const __m256 y = _mm256_sub_ps(mag2, comp);
+        const __m256 t = _mm256_add_ps(sum, y);
+        comp = _mm256_sub_ps(_mm256_sub_ps(t, sum), y);
+        sum = t;
+        const __m256 gt = _mm256_cmp_ps(mag2, maxv, _CMP_GT_OQ);
+        maxv = _mm256_blendv_ps(maxv, mag2, gt);
+        maxi = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(maxi), _mm256_castsi256_ps(idx), gt));
+        idx = _mm256_add_epi32(idx, step);
+    }
+    float maxs[8], sums[8], comps[8];
+    int32_t idxs[8];
+    _mm256_storeu_ps(maxs, maxv);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(idxs), maxi);
+    _mm256_storeu_ps(sums, sum);
+    _mm256_storeu_ps(comps, comp);
+    const size_t maxIndex = detectReduce(maxs, idxs, sums, comps, 8, maxValue, total);
+    return detectTail(in, i, N, maxIndex, maxValue, total);
+}
+
+//! AVX2 detect kernel for exactly 2^LOG2N bins, N is ignored.
+//! Two independent sets of eight lanes take sixteen bins per iteration,
+//! which halves the dependency chains of the compensated sums and the maximum.
+template <size_t LOG2N>
+__attribute__((target("avx2")))
+static inline size_t detectAvx2Sized(
+    const std::complex<float> *in, const size_t,
+    float &maxValue, double &total)
+{
+    const size_t N = size_t(1) << LOG2N;
+    const float *p = reinterpret_cast<const float *>(in);
+    __m256 maxv[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+    __m256i maxi[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()};
+    __m256i idx[2] = {_mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7), _mm256_setr_epi32(8, 9, 12, 13, 10, 11, 14, 15)};
+    const __m256i step = _mm256_set1_epi32(16);
+    __m256 sum[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+    __m256 comp[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+    for (size_t i = 0; i < N; i += 16)
+    {
+        for (size_t j = 0; j < 2; j++)
+        {
+            const __m256 a = _mm256_loadu_ps(p + 2*i + 16*j);
+            const __m256 b = _mm256_loadu_ps(p + 2*i + 16*j + 8);
+            const __m256 mag2 = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+            const __m256 y = _mm256_sub_ps(mag2, comp[j]);
+            const __m256 t = _mm256_add_ps(sum[j], y);
+            comp[j] = _mm256_sub_ps(_mm256_sub_ps(t, sum[j]), y);
+            sum[j] = t;
+            const __m256 gt = _mm256_cmp_ps(mag2, maxv[j], _CMP_GT_OQ);
+            maxv[j] = _mm256_blendv_ps(maxv[j], mag2, gt);
+            maxi[j] = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(maxi[j]), _mm256_castsi256_ps(idx[j]), gt));
+            idx[j] = _mm256_add_epi32(idx[j], step);
+        }
+    }
+    float maxs[16], sums[16], comps[16];
+    int32_t idxs[16];
+    for (size_t j = 0; j < 2; j++)
+    {
+        _mm256_storeu_ps(maxs + 8*j, maxv[j]);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(idxs + 8*j), maxi[j]);
+        _mm256_storeu_ps(sums + 8*j, sum[j]);
+        _mm256_storeu_ps(comps + 8*j, comp[j]);
+    }
+    return detectReduce(maxs, idxs, sums, comps, 16, maxValue, total);
+}
+
+#endif //DETECT_X86_DISPATCH
+
+/*!
+ * Select the fastest detect kernel supported by the running CPU.
+ * The vector kernels find the same bin as the scalar kernel,
+ * the total matches to within float rounding of the lane sums.
+ */
+template <typename Type>
+static inline DetectKernel<Type> getDetectKernel(void)
+{
+    return &detectScalar<Type>;
+}
+
+template <>
+inline DetectKernel<float> getDetectKernel<float>(void)
+{
+    #ifdef DETECT_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return &detectAvx2;
+    if (__builtin_cpu_supports("sse3")) return &detectSse3;
+    #endif //DETECT_X86_DISPATCH
+    return &detectScalar<float>;
+}
+
+/*!
+ * Select the detect kernel for exactly N bins.
+ * With AVX2, the LoRa sizes SF7 to SF12 dispatch to a kernel instance
+ * compiled for that size, other sizes use the kernel from getDetectKernel().
+ */
+template <typename Type>
+static inline DetectKernel<Type> getDetectKernel(const size_t)
+{
+    return getDetectKernel<Type>();
+}
+
+template <>
+inline DetectKernel<float> getDetectKernel<float>(const size_t N)
+{
+    #ifdef DETECT_X86_DISPATCH
+    static const DetectKernel<float> sized[] = {
+        &detectAvx2Sized<7>,
+        &detectAvx2Sized<8>,
+        &detectAvx2Sized<9>,
+        &detectAvx2Sized<10>,
+        &detectAvx2Sized<11>,
+        &detectAvx2Sized<12>,
+    };
+    __builtin_cpu_init();
+    for (size_t log2N = 7; log2N <= 12 and __builtin_cpu_supports("avx2"); log2N++)
+    {
+        if (N == (size_t(1) << log2N)) return sized[log2N-7];
+    }
+    #endif //DETECT_X86_DISPATCH
+    return getDetectKernel<float>();
+}
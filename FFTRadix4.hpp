@@ -0,0 +1,317 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <Pothos/Config.hpp>
+#include <complex>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FFT_RADIX4_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/*!
+ * Precomputed tables of the radix-4 FFT for one power of two size:
+ * the bit reversal permutation of the input and the twiddles of each stage.
+ * A stage combines four transforms of size m into one of size 4m,
+ * its twiddles are v^1, v^2, v^3 with v = exp(-2*pi*j*k/(4m)) for k < m,
+ * stored as three consecutive arrays so that the butterflies load them linearly.
+ */
+struct FFTRadix4Tables
+{
+    FFTRadix4Tables(const size_t log2N):
+        log2N(log2N),
+        N(size_t(1) << log2N),
+        bitrev(N)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            size_t r = 0;
+            for (size_t b = 0; b < log2N; b++) r |= ((i >> b) & 1) << (log2N - 1 - b);
+            bitrev[i] = uint16_t(r);
+        }
+
+        //the first pass is a radix-2 stage when log2N is odd, else a twiddle free radix-4 stage
+        for (size_t m = (log2N % 2 == 1)? 2 : 4; m < N; m *= 4)
+        {
+            for (size_t p = 1; p <= 3; p++)
+            {
+                for (size_t k = 0; k < m; k++)
+                {
+                    twiddles.push_back(std::complex<float>(std::polar(1.0, -2*M_PI*double(p*k)/(4*m))));
+                }
+            }
+        }
+    }
+
+    const size_t log2N;
+    const size_t N;
+    std::vector<uint16_t> bitrev;
+    std::vector<std::complex<float>> twiddles;
+};
+
+//! Complex multiply without the inf/nan recovery of std::complex
+static inline std::complex<float> fftRadix4Mul(const std::complex<float> &a, const std::complex<float> &b)
+{
+    return std::complex<float>(
+        a.real()*b.real() - a.imag()*b.imag(),
+        a.imag()*b.real() + a.real()*b.imag());
+}
+
+//! Multiply by -j
+static inline std::complex<float> fftRadix4MulNegJ(const std::complex<float> &a)
+{
+    return std::complex<float>(a.imag(), -a.real());
+}
+
+/*!
+ * The first pass reads the input in bit reversed order:
+ * a radix-2 stage when log2N is odd, else a radix-4 stage, both twiddle free.
+ */
+template <size_t LOG2N>
+static inline void fftRadix4First(const std::complex<float> *in, std::complex<float> *out, const uint16_t *rev)
+{
+    const size_t N = size_t(1) << LOG2N;
+    if (LOG2N % 2 == 1) for (size_t i = 0; i < N; i += 2)
+    {
+        const auto a0 = in[rev[i+0]];
+        const auto a1 = in[rev[i+1]];
+        out[i+0] = a0 + a1;
+        out[i+1] = a0 - a1;
+    }
+    else for (size_t i = 0; i < N; i += 4)
+    {
+        const auto a0 = in[rev[i+0]];
+        const auto a1 = in[rev[i+1]];
+        const auto a2 = in[rev[i+2]];
+        const auto a3 = in[rev[i+3]];
+        const auto s0 = a0 + a1, d0 = a0 - a1;
+        const auto s1 = a2 + a3, jd1 = fftRadix4MulNegJ(a2 - a3);
+        out[i+0] = s0 + s1;
+        out[i+1] = d0 + jd1;
+        out[i+2] = s0 - s1;
+        out[i+3] = d0 - jd1;
+    }
+}
+
+/*!
+ * One radix-4 decimation in time butterfly over k of a stage with span m:
+ * A1 = v^2*a1, A2 = v*a2, A3 = v^3*a3 where the inputs are
+ * the first and second halves of two radix-2 stages merged into one pass.
+ */
+static inline void fftRadix4Butterfly(std::complex<float> *x, const size_t m, const std::complex<float> *tw, const size_t k)
+{
+    const auto a0 = x[k];
+    const auto A1 = fftRadix4Mul(x[k+m], tw[m+k]);
+    const auto A2 = fftRadix4Mul(x[k+2*m], tw[k]);
+    const auto A3 = fftRadix4Mul(x[k+3*m], tw[2*m+k]);
+    const auto s0 = a0 + A1, d0 = a0 - A1;
+    const auto s1 = A2 + A3, jd1 = fftRadix4MulNegJ(A2 - A3);
+    x[k] = s0 + s1;
+    x[k+m] = d0 + jd1;
+    x[k+2*m] = s0 - s1;
+    x[k+3*m] = d0 - jd1;
+}
+
+/*!
+ * Portable radix-4 FFT, the size is a template parameter so every loop bound is constant.
+ * A batch of K transforms is contiguous: the butterflies of a stage never cross
+ * a transform boundary, so each stage runs once over all K*N samples.
+ */
+template <size_t LOG2N>
+static inline void fftRadix4Scalar(const std::complex<float> *in, std::complex<float> *out, const FFTRadix4Tables &t, const size_t K)
+{
+    const size_t N = size_t(1) << LOG2N;
+    for (size_t j = 0; j < K; j++) fftRadix4First<LOG2N>(in + j*N, out + j*N, t.bitrev.data());
+    auto tw = t.twiddles.data();
+    for (size_t m = (LOG2N % 2 == 1)? 2 : 4; m < N; m *= 4)
+    {
+        for (size_t base = 0; base < K*N; base += 4*m)
+        {
+            for (size_t k = 0; k < m; k++) fftRadix4Butterfly(out + base, m, tw, k);
+        }
+        tw += 3*m;
+    }
+}
+
+#ifdef FFT_RADIX4_X86_DISPATCH
+
+//! Interleaved complex multiply, four samples per register
+__attribute__((target("avx2")))
+static inline __m256 fftRadix4MulAvx2(const __m256 a, const __m256 b)
+{
+    const __m256 t1 = _mm256_mul_ps(a, _mm256_moveldup_ps(b));
+    const __m256 t2 = _mm256_mul_ps(_mm256_permute_ps(a, 0xB1), _mm256_movehdup_ps(b));
+    return _mm256_addsub_ps(t1, t2);
+}
+
+//! Load the complex samples at rev[0], rev[s], rev[2s], rev[3s] into one register
+__attribute__((target("avx2")))
+static inline __m256 fftRadix4GatherAvx2(const std::complex<float> *in, const uint16_t *rev, const size_t s)
+{
+    const __m128 lo = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(),
+        reinterpret_cast<const __m64 *>(in + rev[0])), reinterpret_cast<const __m64 *>(in + rev[s]));
+    const __m128 hi = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(),
+        reinterpret_cast<const __m64 *>(in + rev[2*s])), reinterpret_cast<const __m64 *>(in + rev[3*s]));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+/*!
+ * AVX2 first pass, the vector form of fftRadix4First():
+ * each register holds the same butterfly input of four neighbouring groups,
+ * the outputs are transposed back to sample order on the store.
+ */
+template <size_t LOG2N>
+__attribute__((target("avx2")))
+static inline void fftRadix4FirstAvx2(const std::complex<float> *in, std::complex<float> *out, const uint16_t *rev)
+{
+    const size_t N = size_t(1) << LOG2N;
+    float *x = reinterpret_cast<float *>(out);
+    const __m256 negImag = _mm256_setr_ps(0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f);
+    if (LOG2N % 2 == 1) for (size_t i = 0; i < N; i += 8)
+    {
+        const __m256 a0 = fftRadix4GatherAvx2(in, rev + i + 0, 2);
+        const __m256 a1 = fftRadix4GatherAvx2(in, rev + i + 1, 2);
+        const __m256d o0 = _mm256_castps_pd(_mm256_add_ps(a0, a1));
+        const __m256d o1 = _mm256_castps_pd(_mm256_sub_ps(a0, a1));
+        const __m256d t0 = _mm256_unpacklo_pd(o0, o1);
+        const __m256d t1 = _mm256_unpackhi_pd(o0, o1);
+        _mm256_storeu_ps(x + 2*i + 0, _mm256_castpd_ps(_mm256_permute2f128_pd(t0, t1, 0x20)));
+        _mm256_storeu_ps(x + 2*i + 8, _mm256_castpd_ps(_mm256_permute2f128_pd(t0, t1, 0x31)));
+    }
+    else for (size_t i = 0; i < N; i += 16)
+    {
+        const __m256 a0 = fftRadix4GatherAvx2(in, rev + i + 0, 4);
+        const __m256 a1 = fftRadix4GatherAvx2(in, rev + i + 1, 4);
+        const __m256 a2 = fftRadix4GatherAvx2(in, rev + i + 2, 4);
+        const __m256 a3 = fftRadix4GatherAvx2(in, rev + i + 3, 4);
+        const __m256 s0 = _mm256_add_ps(a0, a1);
+        const __m256 d0 = _mm256_sub_ps(a0, a1);
+        const __m256 s1 = _mm256_add_ps(a2, a3);
+        const __m256 jd1 = _mm256_xor_ps(_mm256_permute_ps(_mm256_sub_ps(a2, a3), 0xB1), negImag);
+        const __m256d o0 = _mm256_castps_pd(_mm256_add_ps(s0, s1));
+        const __m256d o1 = _mm256_castps_pd(_mm256_add_ps(d0, jd1));
+        const __m256d o2 = _mm256_castps_pd(_mm256_sub_ps(s0, s1));
+        const __m256d o3 = _mm256_castps_pd(_mm256_sub_ps(d0, jd1));
+        const __m256d t0 = _mm256_unpacklo_pd(o0, o1);
+        const __m256d t1 = _mm256_unpackhi_pd(o0, o1);
+        const __m256d t2 = _mm256_unpacklo_pd(o2, o3);
+        const __m256d t3 = _mm256_unpackhi_pd(o2, o3);
+        _mm256_storeu_ps(x + 2*i + 0, _mm256_castpd_ps(_mm256_permute2f128_pd(t0, t2, 0x20)));
+        _mm256_storeu_ps(x + 2*i + 8, _mm256_castpd_ps(_mm256_permute2f128_pd(t1, t3, 0x20)));
+        _mm256_storeu_ps(x + 2*i + 16, _mm256_castpd_ps(_mm256_permute2f128_pd(t0, t2, 0x31)));
+        _mm256_storeu_ps(x + 2*i + 24, _mm256_castpd_ps(_mm256_permute2f128_pd(t1, t3, 0x31)));
+    }
+}
+
+//! One AVX2 radix-4 butterfly on four lanes, the vector form of fftRadix4Butterfly()
+__attribute__((target("avx2")))
+static inline void fftRadix4ButterflyAvx2(
+    __m256 &a0, __m256 &a1, __m256 &a2, __m256 &a3,
+    const __m256 w1, const __m256 w2, const __m256 w3)
+{
+    const __m256 negImag = _mm256_setr_ps(0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f);
+    const __m256 A1 = fftRadix4MulAvx2(a1, w1);
+    const __m256 A2 = fftRadix4MulAvx2(a2, w2);
+    const __m256 A3 = fftRadix4MulAvx2(a3, w3);
+    const __m256 s0 = _mm256_add_ps(a0, A1);
+    const __m256 d0 = _mm256_sub_ps(a0, A1);
+    const __m256 s1 = _mm256_add_ps(A2, A3);
+    const __m256 jd1 = _mm256_xor_ps(_mm256_permute_ps(_mm256_sub_ps(A2, A3), 0xB1), negImag);
+    a0 = _mm256_add_ps(s0, s1);
+    a1 = _mm256_add_ps(d0, jd1);
+    a2 = _mm256_sub_ps(s0, s1);
+    a3 = _mm256_sub_ps(d0, jd1);
+}
+
+/*!
+ * AVX2 radix-4 FFT: four butterflies per iteration for the stages with m >= 4,
+ * the m = 2 stage of the odd sizes pairs two neighbouring blocks in one register.
+ */
+template <size_t LOG2N>
+__attribute__((target("avx2")))
+static inline void fftRadix4Avx2(const std::complex<float> *in, std::complex<float> *out, const FFTRadix4Tables &t, const size_t K)
+{
+    const size_t N = size_t(1) << LOG2N;
+    for (size_t j = 0; j < K; j++) fftRadix4FirstAvx2<LOG2N>(in + j*N, out + j*N, t.bitrev.data());
+    auto tw = t.twiddles.data();
+    size_t m = 4;
+    if (LOG2N % 2 == 1)
+    {
+        const float *w = reinterpret_cast<const float *>(tw);
+        const __m256 w1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(w + 4));
+        const __m256 w2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(w + 0));
+        const __m256 w3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(w + 8));
+        for (size_t base = 0; base < K*N; base += 16)
+        {
+            float *x = reinterpret_cast<float *>(out + base);
+            __m256 a0 = _mm256_loadu2_m128(x + 16, x + 0);
+            __m256 a1 = _mm256_loadu2_m128(x + 20, x + 4);
+            __m256 a2 = _mm256_loadu2_m128(x + 24, x + 8);
+            __m256 a3 = _mm256_loadu2_m128(x + 28, x + 12);
+            fftRadix4ButterflyAvx2(a0, a1, a2, a3, w1, w2, w3);
+            _mm256_storeu2_m128(x + 16, x + 0, a0);
+            _mm256_storeu2_m128(x + 20, x + 4, a1);
+            _mm256_storeu2_m128(x + 24, x + 8, a2);
+            _mm256_storeu2_m128(x + 28, x + 12, a3);
+        }
+        tw += 6;
+        m = 8;
+    }
+    for (; m < N; m *= 4)
+    {
+        const float *w = reinterpret_cast<const float *>(tw);
+        for (size_t base = 0; base < K*N; base += 4*m)
+        {
+            float *x = reinterpret_cast<float *>(out + base);
+            for (size_t k = 0; k < m; k += 4)
+            {
+                __m256 a0 = _mm256_loadu_ps(x + 2*k);
+                __m256 a1 = _mm256_loadu_ps(x + 2*(k+m));
+                __m256 a2 = _mm256_loadu_ps(x + 2*(k+2*m));
+                __m256 a3 = _mm256_loadu_ps(x + 2*(k+3*m));
+                fftRadix4ButterflyAvx2(a0, a1, a2, a3,
+                    _mm256_loadu_ps(w + 2*(m+k)), _mm256_loadu_ps(w + 2*k), _mm256_loadu_ps(w + 2*(2*m+k)));
+                _mm256_storeu_ps(x + 2*k, a0);
+                _mm256_storeu_ps(x + 2*(k+m), a1);
+                _mm256_storeu_ps(x + 2*(k+2*m), a2);
+                _mm256_storeu_ps(x + 2*(k+3*m), a3);
+            }
+        }
+        tw += 3*m;
+    }
+}
+
+#endif //FFT_RADIX4_X86_DISPATCH
+
+//! Signature of a size specialized radix-4 FFT over a batch of K transforms
+typedef void (*FFTRadix4Kernel)(const std::complex<float> *in, std::complex<float> *out, const FFTRadix4Tables &t, const size_t K);
+
+//! The smallest and largest size of the radix-4 FFT, the LoRa symbol sizes
+static const size_t FFT_RADIX4_MIN_LOG2N = 7;
+static const size_t FFT_RADIX4_MAX_LOG2N = 12;
+
+/*!
+ * Select the radix-4 kernel for a size and the running CPU.
+ * \param log2N the log2 of the transform size within the LoRa sizes
+ * \return the kernel or nullptr for an unsupported size
+ */
+static inline FFTRadix4Kernel getFFTRadix4Kernel(const size_t log2N)
+{
+    static const FFTRadix4Kernel scalar[] = {
+        &fftRadix4Scalar<7>, &fftRadix4Scalar<8>, &fftRadix4Scalar<9>,
+        &fftRadix4Scalar<10>, &fftRadix4Scalar<11>, &fftRadix4Scalar<12>};
+    if (log2N < FFT_RADIX4_MIN_LOG2N or log2N > FFT_RADIX4_MAX_LOG2N) return nullptr;
+    #ifdef FFT_RADIX4_X86_DISPATCH
+    static const FFTRadix4Kernel avx2[] = {
+        &fftRadix4Avx2<7>, &fftRadix4Avx2<8>, &fftRadix4Avx2<9>,
+        &fftRadix4Avx2<10>, &fftRadix4Avx2<11>, &fftRadix4Avx2<12>};
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return avx2[log2N - FFT_RADIX4_MIN_LOG2N];
+    #endif //FFT_RADIX4_X86_DISPATCH
+    return scalar[log2N - FFT_RADIX4_MIN_LOG2N];
+}
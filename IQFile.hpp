@@ -0,0 +1,233 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <Pothos/Framework.hpp>
+#include <Pothos/Exception.hpp>
+#include <json.hpp>
+#include <complex>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <utility>
+#include <fstream>
+#include <algorithm>
+
+/*!
+ * A sample format of IQ recordings: the short name used by the file extensions,
+ * the SigMF core:datatype and the element type, samples are interleaved little endian.
+ */
+struct IQFileFormat
+{
+    std::string name;
+    std::string datatype;
+    Pothos::DType dtype;
+};
+
+inline const std::vector<IQFileFormat> &getIQFileFormats(void)
+{
+    static const std::vector<IQFileFormat> formats{
+        {"cf32", "cf32_le", Pothos::DType(typeid(std::complex<float>))},
+        {"cs16", "ci16_le", Pothos::DType(typeid(std::complex<int16_t>))},
+        {"cs8", "ci8", Pothos::DType(typeid(std::complex<int8_t>))},
+    };
+    return formats;
+}
+
+//! Find a format by its short name, SigMF datatype or element type
+inline const IQFileFormat *findIQFileFormat(const std::string &name)
+{
+    for (const auto &format : getIQFileFormats())
+    {
+        if (format.name == name or format.datatype == name) return &format;
+    }
+    return nullptr;
+}
+
+inline const IQFileFormat *findIQFileFormat(const Pothos::DType &dtype)
+{
+    for (const auto &format : getIQFileFormats())
+    {
+        if (format.dtype == dtype) return &format;
+    }
+    return nullptr;
+}
+
+static inline bool iqFileEndsWith(const std::string &path, const std::string &suffix)
+{
+    return path.size() >= suffix.size() and path.compare(path.size()-suffix.size(), suffix.size(), suffix) == 0;
+}
+
+//! Is the path one of the files of a SigMF recording?
+inline bool isSigMFPath(const std::string &path)
+{
+    return iqFileEndsWith(path, ".sigmf-meta") or iqFileEndsWith(path, ".sigmf-data");
+}
+
+//! The path of a SigMF recording without the .sigmf-meta or .sigmf-data extension
+inline std::string getSigMFBasePath(const std::string &path)
+{
+    if (isSigMFPath(path)) return path.substr(0, path.size()-std::string(".sigmf-meta").size());
+    return path;
+}
+
+/*!
+ * The data file of a recording and what is known about it:
+ * raw files only carry the format in the name, SigMF recordings also
+ * have the sample rate and the annotations in the metadata file.
+ */
+struct IQFileInfo
+{
+    IQFileInfo(void):
+        format(nullptr),
+        sampleRate(0.0)
+    {
+        return;
+    }
+
+    const IQFileFormat *format;
+    std::string dataPath;
+    double sampleRate;
+    std::vector<std::pair<unsigned long long, std::string>> annotations;
+};
+
+/*!
+ * Resolve the format of a recording.
+ * \param path the raw data file, or either file of a SigMF recording
+ * \param format "auto" to use the extension, "sigmf", or a short name from getIQFileFormats()
+ */
+inline IQFileInfo getIQFileInfo(const std::string &path, const std::string &format)
+{
+    using json = nlohmann::json;
+    IQFileInfo info;
+    info.dataPath = path;
+
+    if (format == "sigmf" or (format == "auto" and isSigMFPath(path)))
+    {
+        const auto base = getSigMFBasePath(path);
+        info.dataPath = base + ".sigmf-data";
+        std::ifstream metaFile(base + ".sigmf-meta");
+        if (not metaFile) throw Pothos::FileNotFoundException("getIQFileInfo("+path+")", "cannot open " + base + ".sigmf-meta");
+        json meta;
+        try
+        {
+            metaFile >> meta;
+            const auto &global = meta.at("global");
+            const auto datatype = global.at("core:datatype").get<std::string>();
+            info.format = findIQFileFormat(datatype);
+            if (info.format == nullptr) throw Pothos::InvalidArgumentException("getIQFileInfo("+path+")", "unsupported datatype " + datatype);
+            if (global.count("core:sample_rate") != 0) info.sampleRate = global["core:sample_rate"].get<double>();
+            if (meta.count("annotations") != 0) for (const auto &annotation : meta["annotations"])
+            {
+                if (annotation.count("core:label") == 0) continue;
+                info.annotations.emplace_back(
+                    annotation.at("core:sample_start").get<unsigned long long>(),
+                    annotation["core:label"].get<std::string>());
+            }
+        }
+        catch (const json::exception &ex)
+        {
+            throw Pothos::DataFormatException("getIQFileInfo("+path+")", ex.what());
+        }
+        std::sort(info.annotations.begin(), info.annotations.end());
+        return info;
+    }
+
+    if (format != "auto") info.format = findIQFileFormat(format);
+    else if (iqFileEndsWith(path, ".cf32") or iqFileEndsWith(path, ".fc32") or iqFileEndsWith(path, ".cfile")) info.format = findIQFileFormat("cf32");
+    else if (iqFileEndsWith(path, ".cs16") or iqFileEndsWith(path, ".sc16")) info.format = findIQFileFormat("cs16");
+    else if (iqFileEndsWith(path, ".cs8") or iqFileEndsWith(path, ".sc8")) info.format = findIQFileFormat("cs8");
+    if (info.format == nullptr) throw Pothos::InvalidArgumentException("getIQFileInfo("+path+", "+format+")", "unknown IQ file format");
+    return info;
+}
+
+/*!
+ * Write the metadata file of a SigMF recording, annotations mark single samples.
+ * \param basePath the recording path without extension
+ */
+inline void writeSigMFMeta(
+    const std::string &basePath,
+    const IQFileFormat &format,
+    const double sampleRate,
+    const std::vector<std::pair<unsigned long long, std::string>> &annotations,
+    const std::string &description = "")
+{
+    using json = nlohmann::json;
+    json meta;
+    meta["global"]["core:datatype"] = format.datatype;
+    meta["global"]["core:version"] = "1.0.0";
+    if (sampleRate > 0.0) meta["global"]["core:sample_rate"] = sampleRate;
+    if (not description.empty()) meta["global"]["core:description"] = description;
+    json capture;
+    capture["core:sample_start"] = 0;
+    meta["captures"] = json::array({capture});
+    meta["annotations"] = json::array();
+    for (const auto &annotation : annotations)
+    {
+        json entry;
+        entry["core:sample_start"] = annotation.first;
+        entry["core:sample_count"] = 1;
+        entry["core:label"] = annotation.second;
+        meta["annotations"].push_back(entry);
+    }
+    std::ofstream metaFile(basePath + ".sigmf-meta");
+    if (not metaFile) throw Pothos::CreateFileException("writeSigMFMeta("+basePath+")", "cannot create " + basePath + ".sigmf-meta");
+    metaFile << meta.dump(2) << std::endl;
+}
+
+/***********************************************************************
+ * Conversion between the sample formats:
+ * integers are scaled to and from +/-1.0, float samples are clipped to the
+ * integer range and rounded, between integer formats only the scale changes.
+ **********************************************************************/
+template <typename Type> struct IQFullScale;
+template <> struct IQFullScale<float>{static constexpr float value = 1.0f;};
+template <> struct IQFullScale<int16_t>{static constexpr float value = 32768.0f;};
+template <> struct IQFullScale<int8_t>{static constexpr float value = 128.0f;};
+
+template <typename Type>
+Type iqSampleCast(const float x)
+{
+    const float max = IQFullScale<Type>::value;
+    return Type(std::lrint(std::min(std::max(x, -max), max - 1.0f)));
+}
+
+template <>
+inline float iqSampleCast<float>(const float x)
+{
+    return x;
+}
+
+template <typename InType, typename OutType>
+void convertIQSamples(const void *inBuff, void *outBuff, const size_t num)
+{
+    auto in = reinterpret_cast<const InType *>(inBuff);
+    auto out = reinterpret_cast<OutType *>(outBuff);
+    const float scale = IQFullScale<OutType>::value/IQFullScale<InType>::value;
+    for (size_t i = 0; i < num*2; i++)
+    {
+        out[i] = iqSampleCast<OutType>(float(in[i])*scale);
+    }
+}
+
+//! Convert num complex samples from one element type into another
+typedef void (*IQConverter)(const void *in, void *out, const size_t num);
+
+template <typename InType>
+IQConverter getIQConverter(const Pothos::DType &outType)
+{
+    if (outType == Pothos::DType(typeid(std::complex<float>))) return &convertIQSamples<InType, float>;
+    if (outType == Pothos::DType(typeid(std::complex<int16_t>))) return &convertIQSamples<InType, int16_t>;
+    if (outType == Pothos::DType(typeid(std::complex<int8_t>))) return &convertIQSamples<InType, int8_t>;
+    return nullptr;
+}
+
+//! Get the converter between two of the formats, or null for other types
+inline IQConverter getIQConverter(const Pothos::DType &inType, const Pothos::DType &outType)
+{
+    if (inType == Pothos::DType(typeid(std::complex<float>))) return getIQConverter<float>(outType);
+    if (inType == Pothos::DType(typeid(std::complex<int16_t>))) return getIQConverter<int16_t>(outType);
+    if (inType == Pothos::DType(typeid(std::complex<int8_t>))) return getIQConverter<int8_t>(outType);
+    return nullptr;
+}
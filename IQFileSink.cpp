@@ -0,0 +1,170 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Framework.hpp>
+#include "IQFile.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+/***********************************************************************
+ * |PothosDoc LoRa IQ File Sink
+ *
+ * Record a stream of complex baseband samples into a file
+ * which the LoRa IQ File Source can replay.
+ *
+ * Input buffers are written straight to the file when the input type
+ * matches the file format, otherwise they are converted first,
+ * float samples are scaled from +/-1.0 and clipped for integer formats.
+ *
+ * <h2>File formats</h2>
+ *
+ * The format is taken from the file extension in automatic mode:
+ * .cf32, .fc32 and .cfile for complex float32, .cs16 and .sc16 for complex int16,
+ * .cs8 and .sc8 for complex int8, and .sigmf-data or .sigmf-meta for SigMF.
+ * A SigMF recording stores the samples in the format of the input type,
+ * the metadata file with the sample rate and the input labels as annotations
+ * is written when the topology deactivates.
+ *
+ * |category /LoRa
+ * |keywords lora file record sigmf
+ *
+ * |param dtype[Data Type] The input data type.
+ * |widget DTypeChooser(cfloat=1,cint=1)
+ * |default "complex_float32"
+ * |preview disable
+ *
+ * |param path[File Path] The path of the recording.
+ * |default ""
+ * |widget FileEntry(mode=save)
+ *
+ * |param format[Format] The sample format of the file.
+ * |option [Automatic] "auto"
+ * |option [SigMF] "sigmf"
+ * |option [Complex float32] "cf32"
+ * |option [Complex int16] "cs16"
+ * |option [Complex int8] "cs8"
+ * |default "auto"
+ *
+ * |param rate[Sample Rate] The sample rate recorded in the SigMF metadata.
+ * |units samples/sec
+ * |default 0.0
+ *
+ * |factory /lora/iq_file_sink(dtype)
+ * |setter setFilePath(path)
+ * |setter setFormat(format)
+ * |setter setSampleRate(rate)
+ **********************************************************************/
+class IQFileSink : public Pothos::Block
+{
+public:
+    IQFileSink(const Pothos::DType &dtype):
+        _format("auto"),
+        _sampleRate(0.0),
+        _fileFormat(nullptr),
+        _sigmf(false),
+        _convert(nullptr),
+        _file(nullptr)
+    {
+        this->registerCall(this, POTHOS_FCN_TUPLE(IQFileSink, setFilePath));
+        this->registerCall(this, POTHOS_FCN_TUPLE(IQFileSink, setFormat));
+        this->registerCall(this, POTHOS_FCN_TUPLE(IQFileSink, setSampleRate));
+        this->setupInput(0, dtype);
+        if (findIQFileFormat(dtype) == nullptr) throw Pothos::InvalidArgumentException(
+            "IQFileSink("+dtype.toString()+")", "unsupported data type");
+    }
+
+    static Block *make(const Pothos::DType &dtype)
+    {
+        return new IQFileSink(dtype);
+    }
+
+    void setFilePath(const std::string &path)
+    {
+        _path = path;
+    }
+
+    void setFormat(const std::string &format)
+    {
+        if (format != "auto" and format != "sigmf" and findIQFileFormat(format) == nullptr)
+        {
+            throw Pothos::InvalidArgumentException("IQFileSink::setFormat("+format+")", "unknown IQ file format");
+        }
+        _format = format;
+    }
+
+    void setSampleRate(const double rate)
+    {
+        _sampleRate = rate;
+    }
+
+    void activate(void)
+    {
+        const auto inType = this->input(0)->dtype();
+        _sigmf = (_format == "sigmf" or (_format == "auto" and isSigMFPath(_path)));
+        auto dataPath = _path;
+        if (_sigmf)
+        {
+            _fileFormat = findIQFileFormat(inType);
+            dataPath = getSigMFBasePath(_path) + ".sigmf-data";
+        }
+        else _fileFormat = getIQFileInfo(_path, _format).format;
+
+        _convert = nullptr;
+        if (not (_fileFormat->dtype == inType)) _convert = getIQConverter(inType, _fileFormat->dtype);
+
+        _file = std::fopen(dataPath.c_str(), "wb");
+        if (_file == nullptr) throw Pothos::CreateFileException("IQFileSink::activate("+dataPath+")", std::strerror(errno));
+        _annotations.clear();
+    }
+
+    void deactivate(void)
+    {
+        if (_file != nullptr) std::fclose(_file);
+        _file = nullptr;
+        if (_sigmf) writeSigMFMeta(getSigMFBasePath(_path), *_fileFormat, _sampleRate, _annotations);
+    }
+
+    void work(void)
+    {
+        auto inPort = this->input(0);
+        const size_t numElems = inPort->elements();
+        if (numElems == 0) return;
+
+        if (_sigmf) for (const auto &label : inPort->labels())
+        {
+            if (label.index >= numElems) break;
+            _annotations.emplace_back(inPort->totalElements() + label.index, label.id);
+        }
+
+        const void *writeBuff = inPort->buffer().as<const void *>();
+        if (_convert != nullptr)
+        {
+            _writeBuff.resize(numElems*_fileFormat->dtype.size());
+            _convert(writeBuff, _writeBuff.data(), numElems);
+            writeBuff = _writeBuff.data();
+        }
+        if (std::fwrite(writeBuff, _fileFormat->dtype.size(), numElems, _file) != numElems)
+        {
+            throw Pothos::WriteFileException("IQFileSink::work("+_path+")", std::strerror(errno));
+        }
+        inPort->consume(numElems);
+    }
+
+private:
+    //configuration
+    std::string _path;
+    std::string _format;
+    double _sampleRate;
+
+    //file
+    const IQFileFormat *_fileFormat;
+    bool _sigmf;
+    IQConverter _convert;
+    std::FILE *_file;
+    std::vector<char> _writeBuff;
+    std::vector<std::pair<unsigned long long, std::string>> _annotations;
+};
+
+static Pothos::BlockRegistry registerIQFileSink(
+    "/lora/iq_file_sink", &IQFileSink::make);
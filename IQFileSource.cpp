@@ -0,0 +1,373 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Framework.hpp>
+#include "IQFile.hpp"
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#ifdef HAS_SYS_MMAN_H
+#include <sys/mman.h>
+#endif //HAS_SYS_MMAN_H
+
+/*!
+ * A read-only mapping of a whole file, shared by every buffer sliced from it.
+ * The count of slices in flight lets the source hold back when the
+ * downstream blocks fall behind instead of queuing the entire file.
+ */
+struct IQFileMapping
+{
+    IQFileMapping(void *addr, const size_t length):
+        addr(addr),
+        length(length),
+        inFlight(0)
+    {
+        return;
+    }
+
+    ~IQFileMapping(void)
+    {
+        #ifdef HAS_SYS_MMAN_H
+        munmap(addr, length);
+        #endif //HAS_SYS_MMAN_H
+    }
+
+    void release(void)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight--;
+        cond.notify_one();
+    }
+
+    void *addr;
+    const size_t length;
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t inFlight;
+};
+
+/***********************************************************************
+ * |PothosDoc LoRa IQ File Source
+ *
+ * Replay a recording of complex baseband samples, for example to benchmark
+ * the demodulator or to run it over captures from the field.
+ *
+ * When the element type of the file matches the output type,
+ * the file is memory mapped and the output buffers are slices of the mapping:
+ * the samples reach the downstream block without a copy.
+ * Other element types are converted into the output buffers,
+ * integers are scaled to and from +/-1.0 for float.
+ * Without mmap support the file is read into the output buffers.
+ *
+ * <h2>File formats</h2>
+ *
+ * <ul>
+ * <li>cf32 (.cf32, .fc32, .cfile) - complex float32</li>
+ * <li>cs16 (.cs16, .sc16) - complex int16</li>
+ * <li>cs8 (.cs8, .sc8) - complex int8</li>
+ * <li>sigmf (.sigmf-meta, .sigmf-data) - the datatype comes from the metadata,
+ * annotations with a core:label are posted as labels on their first sample</li>
+ * </ul>
+ *
+ * <h2>Pacing</h2>
+ *
+ * By default the source runs as fast as the downstream blocks consume.
+ * With pacing enabled, the samples are released at the sample rate,
+ * or at the rate in the SigMF metadata when the sample rate is 0.
+ *
+ * |category /LoRa
+ * |keywords lora file replay sigmf mmap
+ *
+ * |param dtype[Data Type] The output data type.
+ * |widget DTypeChooser(cfloat=1,cint=1)
+ * |default "complex_float32"
+ * |preview disable
+ *
+ * |param path[File Path] The path of the recording.
+ * |default ""
+ * |widget FileEntry(mode=open)
+ *
+ * |param format[Format] The sample format of the file.
+ * |option [Automatic] "auto"
+ * |option [SigMF] "sigmf"
+ * |option [Complex float32] "cf32"
+ * |option [Complex int16] "cs16"
+ * |option [Complex int8] "cs8"
+ * |default "auto"
+ *
+ * |param loop[Loop] Start over at the end of the file.
+ * |option [Disabled] false
+ * |option [Enabled] true
+ * |default false
+ *
+ * |param pacing[Pacing] Release the samples in real time.
+ * |option [Disabled] false
+ * |option [Enabled] true
+ * |default false
+ *
+ * |param rate[Sample Rate] The sample rate for pacing, 0 uses the SigMF metadata.
+ * |units samples/sec
+ * |default 0.0
+ *
+ * |param chunk[Chunk Size] The number of samples in each output buffer.
+ * |units samples
+ * |default 65536
+ * |preview valid
+ *
+ * |factory /lora/iq_file_source(dtype)
+ * |setter setFilePath(path)
+ * |setter setFormat(format)
+ * |setter setLoop(loop)
+ * |setter setPacing(pacing)
+ * |setter setSampleRate(rate)
+ * |setter setChunkSize(chunk)
+ **********************************************************************/
+class IQFileSource : public Pothos::Block
+{
+public:
+    //! Slices of the mapping in flight before the source waits for the downstream
+    static const size_t MAX_SLICES = 8;
+
+    IQFileSource(const Pothos::DType &dtype):
+        _format("auto"),
+        _loop(false),
+        _pacing(false),
+        _sampleRate(0.0),
+        _chunk(65536),
+        _convert(nullptr),
+        _file(nullptr),
+        _elemSize(0),
+        _numElems(0),
+        _position(0),
+        _released(0),
+        _nextAnnotation(0)
+    {
+        this->registerCall(this, POTHOS_FCN_TUPLE(IQFileSource, setFilePath));
+        this->registerCall(this, POTHOS_FCN_TUPLE(IQFileSource, setFormat));
+        this->registerCall(this, POTHOS_FCN_TUPLE(IQFileSource, setLoop));
+        this->registerCall(this, POTHOS_FCN_TUPLE(IQFileSource, setPacing));
+        this->registerCall(this, POTHOS_FCN_TUPLE(IQFileSource, setSampleRate));
+        this->registerCall(this, POTHOS_FCN_TUPLE(IQFileSource, setChunkSize));
+        this->registerCall(this, POTHOS_FCN_TUPLE(IQFileSource, getFileSampleRate));
+        this->setupOutput(0, dtype);
+        if (findIQFileFormat(dtype) == nullptr) throw Pothos::InvalidArgumentException(
+            "IQFileSource("+dtype.toString()+")", "unsupported data type");
+    }
+
+    static Block *make(const Pothos::DType &dtype)
+    {
+        return new IQFileSource(dtype);
+    }
+
+    void setFilePath(const std::string &path)
+    {
+        _path = path;
+    }
+
+    void setFormat(const std::string &format)
+    {
+        if (format != "auto" and format != "sigmf" and findIQFileFormat(format) == nullptr)
+        {
+            throw Pothos::InvalidArgumentException("IQFileSource::setFormat("+format+")", "unknown IQ file format");
+        }
+        _format = format;
+    }
+
+    void setLoop(const bool loop)
+    {
+        _loop = loop;
+    }
+
+    void setPacing(const bool pacing)
+    {
+        _pacing = pacing;
+        _paceStart = std::chrono::steady_clock::now();
+        _released = 0;
+    }
+
+    void setSampleRate(const double rate)
+    {
+        if (rate < 0.0) throw Pothos::InvalidArgumentException("IQFileSource::setSampleRate("+std::to_string(rate)+")", "negative sample rate");
+        _sampleRate = rate;
+        _paceStart = std::chrono::steady_clock::now();
+        _released = 0;
+    }
+
+    void setChunkSize(const size_t chunk)
+    {
+        if (chunk == 0) throw Pothos::InvalidArgumentException("IQFileSource::setChunkSize("+std::to_string(chunk)+")", "chunk size must be positive");
+        _chunk = chunk;
+    }
+
+    //! The sample rate from the SigMF metadata of the last activation, 0 when unknown
+    double getFileSampleRate(void) const
+    {
+        return _info.sampleRate;
+    }
+
+    void activate(void)
+    {
+        _info = getIQFileInfo(_path, _format);
+        _elemSize = _info.format->dtype.size();
+        _convert = nullptr;
+        if (not (_info.format->dtype == this->output(0)->dtype()))
+        {
+            _convert = getIQConverter(_info.format->dtype, this->output(0)->dtype());
+        }
+
+        _file = std::fopen(_info.dataPath.c_str(), "rb");
+        if (_file == nullptr) throw Pothos::FileNotFoundException("IQFileSource::activate("+_info.dataPath+")", std::strerror(errno));
+        std::fseek(_file, 0, SEEK_END);
+        _numElems = size_t(std::ftell(_file))/_elemSize;
+        std::fseek(_file, 0, SEEK_SET);
+
+        //map the file when there is something to map, otherwise read it
+        #ifdef HAS_SYS_MMAN_H
+        if (_numElems != 0)
+        {
+            const size_t length = _numElems*_elemSize;
+            void *addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fileno(_file), 0);
+            if (addr != MAP_FAILED)
+            {
+                madvise(addr, length, MADV_SEQUENTIAL);
+                _mapping.reset(new IQFileMapping(addr, length));
+            }
+        }
+        #endif //HAS_SYS_MMAN_H
+
+        _position = 0;
+        _nextAnnotation = 0;
+        _paceStart = std::chrono::steady_clock::now();
+        _released = 0;
+    }
+
+    void deactivate(void)
+    {
+        _mapping.reset();
+        if (_file != nullptr) std::fclose(_file);
+        _file = nullptr;
+    }
+
+    void work(void)
+    {
+        auto outPort = this->output(0);
+
+        if (_position == _numElems)
+        {
+            if (not _loop or _numElems == 0) return;
+            _position = 0;
+            _nextAnnotation = 0;
+            if (not _mapping) std::fseek(_file, 0, SEEK_SET);
+        }
+
+        size_t numElems = std::min(_chunk, _numElems - _position);
+        if (not _mapping or _convert != nullptr) numElems = std::min(numElems, outPort->elements());
+        numElems = this->paceElements(numElems);
+        if (numElems == 0) return;
+
+        //slices of the mapping are only handed out while the downstream keeps up
+        if (_mapping and _convert == nullptr and not this->waitSlice()) return;
+
+        //annotations are labels on the samples in this chunk
+        const auto &annotations = _info.annotations;
+        while (_nextAnnotation < annotations.size() and annotations[_nextAnnotation].first < _position + numElems)
+        {
+            const auto &annotation = annotations[_nextAnnotation++];
+            if (annotation.first < _position) continue;
+            outPort->postLabel(Pothos::Label(annotation.second, Pothos::Object(), annotation.first - _position));
+        }
+
+        if (_mapping)
+        {
+            const auto addr = reinterpret_cast<const char *>(_mapping->addr) + _position*_elemSize;
+            if (_convert == nullptr)
+            {
+                //the slice holds the mapping open until the downstream releases it
+                const auto mapping = _mapping;
+                std::shared_ptr<void> container(mapping.get(), [mapping](void *){mapping->release();});
+                Pothos::BufferChunk buffer(Pothos::SharedBuffer(size_t(addr), numElems*_elemSize, container));
+                buffer.dtype = outPort->dtype();
+                outPort->postBuffer(buffer);
+            }
+            else
+            {
+                _convert(addr, outPort->buffer().as<void *>(), numElems);
+                outPort->produce(numElems);
+            }
+        }
+        else
+        {
+            void *readBuff = outPort->buffer().as<void *>();
+            if (_convert != nullptr)
+            {
+                _readBuff.resize(numElems*_elemSize);
+                readBuff = _readBuff.data();
+            }
+            numElems = std::fread(readBuff, _elemSize, numElems, _file);
+            if (_convert != nullptr) _convert(readBuff, outPort->buffer().as<void *>(), numElems);
+            outPort->produce(numElems);
+        }
+        _position += numElems;
+        _released += numElems;
+    }
+
+private:
+    //! Wait within the work timeout until another slice may go out
+    bool waitSlice(void)
+    {
+        std::unique_lock<std::mutex> lock(_mapping->mutex);
+        const auto timeout = std::chrono::nanoseconds(this->workInfo().maxTimeoutNs);
+        if (not _mapping->cond.wait_for(lock, timeout, [this]{return _mapping->inFlight < MAX_SLICES;})) return false;
+        _mapping->inFlight++;
+        return true;
+    }
+
+    //! Limit the samples to what the pacing allows, waiting within the work timeout
+    size_t paceElements(const size_t numElems)
+    {
+        const double rate = (_sampleRate > 0.0)? _sampleRate : _info.sampleRate;
+        if (not _pacing or rate <= 0.0) return numElems;
+
+        const auto due = _paceStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>((_released + 1)/rate));
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(this->workInfo().maxTimeoutNs);
+        std::this_thread::sleep_until(std::min(due, deadline));
+
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - _paceStart).count();
+        const auto allowed = (unsigned long long)(elapsed*rate);
+        if (allowed <= _released) return 0;
+        return size_t(std::min<unsigned long long>(numElems, allowed - _released));
+    }
+
+    //configuration
+    std::string _path;
+    std::string _format;
+    bool _loop;
+    bool _pacing;
+    double _sampleRate;
+    size_t _chunk;
+
+    //file
+    IQFileInfo _info;
+    IQConverter _convert;
+    std::FILE *_file;
+    std::shared_ptr<IQFileMapping> _mapping;
+    std::vector<char> _readBuff;
+    size_t _elemSize;
+    size_t _numElems;
+
+    //state
+    size_t _position;
+    std::chrono::steady_clock::time_point _paceStart;
+    unsigned long long _released;
+    size_t _nextAnnotation;
+};
+
+static Pothos::BlockRegistry registerIQFileSource(
+    "/lora/iq_file_source", &IQFileSource::make);
@@ -0,0 +1,336 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include "IQFile.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+/*!
+ * Triggered capture of the input stream of a demodulator into SigMF recordings.
+ *
+ * The samples are copied into a ring of twice the recording length as they are consumed.
+ * A trigger at a sample index waits until half of a recording follows the trigger,
+ * then publishes the start and end index of the window in a free slot.
+ * The writer thread copies the window and its annotations out of the rings and writes the files,
+ * the spare half of the ring keeps the window intact while the writer catches up.
+ * The DSP thread only copies into the rings and flips the slot states, it never takes a lock:
+ * when both slots are still busy, the capture is dropped and counted,
+ * and a window which the ring overwrote before the writer copied it is counted as an overrun.
+ * Labels are not copied, they must be string literals or outlive the capture.
+ */
+class LoRaCapture
+{
+public:
+    static const size_t NUM_SLOTS = 2;
+    static const size_t MAX_ANNOTATIONS = 1024;
+
+    //! A labeled sample index, a trigger label is written as capture:<label>
+    struct Annotation
+    {
+        unsigned long long index;
+        const char *label;
+        bool trigger;
+    };
+
+    /*!
+     * \param basePath recordings are named basePath_<number>.sigmf-data/meta
+     * \param format the format of the samples passed to write()
+     * \param length the number of samples in each recording
+     * \param sampleRate the sample rate written to the metadata
+     */
+    LoRaCapture(const std::string &basePath, const IQFileFormat &format, const size_t length, const double sampleRate):
+        triggers(0),
+        merged(0),
+        dropped(0),
+        written(0),
+        errors(0),
+        overruns(0),
+        _basePath(basePath),
+        _format(format),
+        _elemSize(format.dtype.size()),
+        _length(length),
+        _ringLength(2*length),
+        _sampleRate(sampleRate),
+        _ring(_ringLength*_elemSize),
+        _annotations(MAX_ANNOTATIONS),
+        _numAnnotations(0),
+        _total(0),
+        _pending(false),
+        _pendingEnd(0),
+        _reason(""),
+        _sequence(0),
+        _ringEnd(0),
+        _annotationsEnd(0),
+        _slots(NUM_SLOTS),
+        _done(false)
+    {
+        for (auto &slot : _slots)
+        {
+            slot.samples.resize(_length*_elemSize);
+            slot.annotations.reserve(MAX_ANNOTATIONS);
+        }
+        _thread = std::thread(&LoRaCapture::writerLoop, this);
+    }
+
+    //! Capture the pending window as far as it got and finish the queued writes
+    ~LoRaCapture(void)
+    {
+        if (_pending) this->publish();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _done = true;
+        }
+        _cond.notify_one();
+        _thread.join();
+    }
+
+    //! Append samples in stream order, the first sample has index 0
+    void write(const void *samps, const size_t num)
+    {
+        auto in = reinterpret_cast<const char *>(samps);
+        size_t remaining = num;
+        while (remaining != 0)
+        {
+            //stop at the end of a pending window to capture it exactly
+            size_t n = std::min(remaining, _length);
+            if (_pending) n = size_t(std::min<unsigned long long>(n, _pendingEnd - _total));
+
+            //announce the overwritten range before touching it, the writer checks it after its copy
+            _ringEnd.store(_total + n, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            const size_t ringPos = size_t(_total % _ringLength);
+            const size_t first = std::min(n, _ringLength - ringPos);
+            std::memcpy(_ring.data() + ringPos*_elemSize, in, first*_elemSize);
+            std::memcpy(_ring.data(), in + first*_elemSize, (n - first)*_elemSize);
+            in += n*_elemSize;
+            remaining -= n;
+            _total += n;
+            if (_pending and _total == _pendingEnd) this->publish();
+        }
+    }
+
+    //! Label a sample index, the newest MAX_ANNOTATIONS labels are kept.
+    //! The label is not copied, it must be a string literal or outlive the capture.
+    void annotate(const unsigned long long index, const char *label, const bool trigger = false)
+    {
+        _annotationsEnd.store(_numAnnotations + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        auto &annotation = _annotations[_numAnnotations++ % MAX_ANNOTATIONS];
+        annotation.index = index;
+        annotation.label = label;
+        annotation.trigger = trigger;
+    }
+
+    //! Capture the window centered on a sample index, which may be ahead of the written samples.
+    //! A trigger inside a pending window only adds its annotation to that window.
+    //! Like a label, the reason must be a string literal or outlive the capture.
+    void trigger(const unsigned long long index, const char *reason)
+    {
+        triggers++;
+        this->annotate(std::max(index, _total), reason, true);
+        if (_pending)
+        {
+            merged++;
+            return;
+        }
+        _pending = true;
+        _pendingEnd = std::max(index, _total) + _length/2;
+        _reason = reason;
+    }
+
+    //! The number of samples written so far, the index of the next sample
+    unsigned long long total(void) const
+    {
+        return _total;
+    }
+
+    //counters, the DSP thread owns the first three
+    unsigned long long triggers;
+    unsigned long long merged;
+    unsigned long long dropped;
+    std::atomic<unsigned long long> written;
+    std::atomic<unsigned long long> errors;
+    std::atomic<unsigned long long> overruns;
+
+private:
+    //! A free slot belongs to the DSP thread, a queued or copied slot to the writer thread
+    enum SlotState {SLOT_FREE, SLOT_QUEUED, SLOT_COPIED};
+
+    struct Slot
+    {
+        Slot(void):
+            state(SLOT_FREE),
+            reason(""),
+            start(0),
+            num(0),
+            numAnnotations(0),
+            sequence(0)
+        {
+            return;
+        }
+        std::atomic<SlotState> state;
+        std::vector<char> samples;
+        std::vector<Annotation> annotations;
+        const char *reason;
+        unsigned long long start;
+        size_t num;
+        unsigned long long numAnnotations;
+        unsigned long long sequence;
+    };
+
+    //! Publish the window ending at the current sample in a free slot
+    void publish(void)
+    {
+        _pending = false;
+        Slot *slot = nullptr;
+        for (auto &s : _slots) if (s.state.load(std::memory_order_acquire) == SLOT_FREE) slot = &s;
+        if (slot == nullptr)
+        {
+            dropped++;
+            return;
+        }
+        slot->num = size_t(std::min<unsigned long long>(_total, _length));
+        slot->start = _total - slot->num;
+        slot->numAnnotations = _numAnnotations;
+        slot->reason = _reason;
+        slot->sequence = _sequence++;
+        slot->state.store(SLOT_QUEUED, std::memory_order_release);
+
+        //the writer also polls, so a wakeup lost without the lock only delays it
+        _cond.notify_one();
+    }
+
+    //! Copy the window of a queued slot out of the rings, false when the ring overwrote it
+    bool copyOut(Slot &slot)
+    {
+        const size_t ringPos = size_t(slot.start % _ringLength);
+        const size_t first = std::min(slot.num, _ringLength - ringPos);
+        std::memcpy(slot.samples.data(), _ring.data() + ringPos*_elemSize, first*_elemSize);
+        std::memcpy(slot.samples.data() + first*_elemSize, _ring.data(), (slot.num - first)*_elemSize);
+
+        //the labels are copied as they are, then the ones the DSP thread overwrote meanwhile are dropped
+        slot.annotations.clear();
+        const unsigned long long end = slot.numAnnotations;
+        const unsigned long long begin = end - std::min<unsigned long long>(end, MAX_ANNOTATIONS);
+        for (unsigned long long i = begin; i < end; i++) slot.annotations.push_back(_annotations[i % MAX_ANNOTATIONS]);
+
+        //anything the DSP thread started writing during the copies shows up here
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const auto annotationsEnd = _annotationsEnd.load(std::memory_order_relaxed);
+        const size_t overwritten = size_t(std::min(end, std::max(annotationsEnd, begin + MAX_ANNOTATIONS) - MAX_ANNOTATIONS) - begin);
+        slot.annotations.erase(slot.annotations.begin(), slot.annotations.begin() + overwritten);
+        const auto start = slot.start;
+        const auto stop = slot.start + slot.num;
+        slot.annotations.erase(std::remove_if(slot.annotations.begin(), slot.annotations.end(),
+            [start, stop](const Annotation &a){return a.index < start or a.index >= stop;}), slot.annotations.end());
+        for (auto &annotation : slot.annotations) annotation.index -= start;
+        return _ringEnd.load(std::memory_order_relaxed) <= slot.start + _ringLength;
+    }
+
+    //! The oldest slot in a state, or null
+    Slot *oldest(const SlotState state)
+    {
+        Slot *next = nullptr;
+        for (auto &s : _slots)
+        {
+            if (s.state.load(std::memory_order_acquire) != state) continue;
+            if (next == nullptr or s.sequence < next->sequence) next = &s;
+        }
+        return next;
+    }
+
+    //! Write the SigMF recording of a copied slot
+    void writeSlot(const Slot &slot)
+    {
+        const auto path = _basePath + "_" + std::to_string(slot.sequence);
+        bool ok = false;
+        auto file = std::fopen((path + ".sigmf-data").c_str(), "wb");
+        if (file != nullptr)
+        {
+            ok = std::fwrite(slot.samples.data(), _elemSize, slot.num, file) == slot.num;
+            ok = (std::fclose(file) == 0) and ok;
+        }
+        try
+        {
+            std::vector<std::pair<unsigned long long, std::string>> annotations;
+            for (const auto &annotation : slot.annotations)
+            {
+                annotations.emplace_back(annotation.index,
+                    std::string(annotation.trigger?"capture:":"") + annotation.label);
+            }
+            if (ok) writeSigMFMeta(path, _format, _sampleRate, annotations,
+                std::string("LoRa demod capture on ") + slot.reason + " from input sample " + std::to_string(slot.start));
+        }
+        catch (const Pothos::Exception &)
+        {
+            ok = false;
+        }
+        if (ok) written++;
+        else errors++;
+    }
+
+    //! Copy out the queued windows first, then write the copied slots in order until destruction
+    void writerLoop(void)
+    {
+        while (true)
+        {
+            Slot *slot = this->oldest(SLOT_QUEUED);
+            if (slot != nullptr)
+            {
+                if (this->copyOut(*slot)) slot->state.store(SLOT_COPIED, std::memory_order_release);
+                else
+                {
+                    overruns++;
+                    slot->state.store(SLOT_FREE, std::memory_order_release);
+                }
+                continue;
+            }
+            slot = this->oldest(SLOT_COPIED);
+            if (slot != nullptr)
+            {
+                this->writeSlot(*slot);
+                slot->state.store(SLOT_FREE, std::memory_order_release);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_done and this->oldest(SLOT_QUEUED) == nullptr) return;
+            _cond.wait_for(lock, std::chrono::milliseconds(50));
+        }
+    }
+
+    //configuration
+    const std::string _basePath;
+    const IQFileFormat _format;
+    const size_t _elemSize;
+    const size_t _length;
+    const size_t _ringLength;
+    const double _sampleRate;
+
+    //state of the DSP thread, the writer thread reads the rings
+    std::vector<char> _ring;
+    std::vector<Annotation> _annotations;
+    unsigned long long _numAnnotations;
+    unsigned long long _total;
+    bool _pending;
+    unsigned long long _pendingEnd;
+    const char *_reason;
+    unsigned long long _sequence;
+
+    //shared with the writer thread
+    std::atomic<unsigned long long> _ringEnd;
+    std::atomic<unsigned long long> _annotationsEnd;
+    std::vector<Slot> _slots;
+    bool _done;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::thread _thread;
+};
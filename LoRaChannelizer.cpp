@@ -0,0 +1,187 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Framework.hpp>
+#include <iostream>
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "kissfft.hh"
+
+/***********************************************************************
+ * |PothosDoc LoRa Channelizer
+ *
+ * Split a wideband complex sample stream into equally spaced channels
+ * using an FFT based polyphase filterbank. One shared filterbank costs
+ * a few filter taps and one M-point FFT per M input samples,
+ * rather than a separate mixer and filter chain per channel.
+ *
+ * <h2>Input format</h2>
+ *
+ * The input port 0 accepts a complex sample stream at rate Fs
+ * which contains M channels spaced Fs/M apart.
+ *
+ * <h2>Output format</h2>
+ *
+ * Each output port k produces the critically sampled complex stream
+ * of the channel centered at k*Fs/M, at a sample rate of Fs/M.
+ * The upper half of the ports carry the negative frequency channels:
+ * port M-1 is centered at -Fs/M, port M-2 at -2*Fs/M, and so on.
+ * The output buffers are sized so that a downstream LoRa Demod
+ * can satisfy its two symbol input reserve from a single slab.
+ *
+ * |category /LoRa
+ * |keywords lora channelizer polyphase filterbank
+ *
+ * |param channels[Channels] The number of output channels M.
+ * |default 8
+ *
+ * |param taps[Taps per channel] The length of each polyphase filter branch.
+ * Longer branches give a sharper transition band between channels.
+ * |default 12
+ *
+ * |param sf[Max spread factor] The largest spread factor of the downstream demodulators.
+ * The output buffers hold at least two symbols of this spread factor.
+ * |default 12
+ *
+ * |factory /lora/channelizer(channels)
+ * |initializer setTaps(taps)
+ * |initializer setMaxSpreadFactor(sf)
+ **********************************************************************/
+class LoRaChannelizer : public Pothos::Block
+{
+public:
+    LoRaChannelizer(const size_t channels):
+        M(channels),
+        _maxN(1 << 12),
+        _fft(channels, true),
+        _fftInput(channels),
+        _fftOutput(channels)
+    {
+        if (M < 2) throw Pothos::InvalidArgumentException(
+            "LoRaChannelizer("+std::to_string(M)+")", "need at least two channels");
+
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaChannelizer, setTaps));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaChannelizer, setMaxSpreadFactor));
+        this->setupInput(0, typeid(std::complex<float>));
+        for (size_t k = 0; k < M; k++) this->setupOutput(k, typeid(std::complex<float>));
+
+        //consume one commutator cycle at a time
+        this->input(0)->setReserve(M);
+
+        this->setTaps(12);
+    }
+
+    static Block *make(const size_t channels)
+    {
+        return new LoRaChannelizer(channels);
+    }
+
+    void setTaps(const size_t taps)
+    {
+        if (taps < 1) throw Pothos::InvalidArgumentException(
+            "LoRaChannelizer::setTaps("+std::to_string(taps)+")", "need at least one tap");
+        P = taps;
+
+        //windowed sinc prototype lowpass with the cutoff at half the channel spacing,
+        //tap h[p*M + r] is the p-th tap of polyphase branch r
+        const size_t L = M*P;
+        std::vector<double> h(L);
+        double total = 0.0;
+        for (size_t n = 0; n < L; n++)
+        {
+            const double x = (double(n) - (L-1)/2.0)/M;
+            const double sinc = (x == 0.0)? 1.0 : std::sin(M_PI*x)/(M_PI*x);
+            const double w = 2*M_PI*n/(L-1);
+            const double bh = 0.35875 - 0.48829*std::cos(w) + 0.14128*std::cos(2*w) - 0.01168*std::cos(3*w);
+            h[n] = sinc*bh;
+            total += h[n];
+        }
+        _taps.resize(L);
+        for (size_t n = 0; n < L; n++) _taps[n] = float(h[n]/total);
+
+        _delayLine.assign(L, 0.0f);
+        _head = 0;
+    }
+
+    void setMaxSpreadFactor(const size_t sf)
+    {
+        if (sf < 7 or sf > 12) throw Pothos::InvalidArgumentException(
+            "LoRaChannelizer::setMaxSpreadFactor("+std::to_string(sf)+")", "spread factor out of range");
+        _maxN = 1 << sf;
+    }
+
+    void activate(void)
+    {
+        std::fill(_delayLine.begin(), _delayLine.end(), std::complex<float>(0.0f));
+        _head = 0;
+    }
+
+    void work(void)
+    {
+        auto inPort = this->input(0);
+        size_t numBlocks = inPort->elements()/M;
+        for (size_t k = 0; k < M; k++) numBlocks = std::min(numBlocks, this->output(k)->elements());
+        if (numBlocks == 0) return;
+
+        auto inBuff = inPort->buffer().as<const std::complex<float> *>();
+        _outBuffs.resize(M);
+        for (size_t k = 0; k < M; k++) _outBuffs[k] = this->output(k)->buffer().as<std::complex<float> *>();
+
+        for (size_t b = 0; b < numBlocks; b++)
+        {
+            //commutate the newest block into the delay line in reverse order
+            auto slot = _delayLine.data() + _head*M;
+            const auto blk = inBuff + b*M;
+            for (size_t r = 0; r < M; r++) slot[r] = blk[M-1-r];
+
+            //filter each branch against the delay line from newest to oldest
+            std::fill(_fftInput.begin(), _fftInput.end(), std::complex<float>(0.0f));
+            size_t d = _head;
+            for (size_t p = 0; p < P; p++)
+            {
+                const auto taps = _taps.data() + p*M;
+                const auto line = _delayLine.data() + d*M;
+                for (size_t r = 0; r < M; r++) _fftInput[r] += line[r]*taps[r];
+                d = (d == 0)? P-1 : d-1;
+            }
+            _head = (_head + 1 == P)? 0 : _head + 1;
+
+            //the inverse FFT across the branches separates the channels
+            _fft.transform(_fftInput.data(), _fftOutput.data());
+            for (size_t k = 0; k < M; k++) _outBuffs[k][b] = _fftOutput[k];
+        }
+
+        inPort->consume(numBlocks*M);
+        for (size_t k = 0; k < M; k++) this->output(k)->produce(numBlocks);
+    }
+
+    //! Custom output buffer manager with slabs large enough for the demod reserve,
+    //! every output port is a channel so the name and domain are not inspected
+    Pothos::BufferManager::Sptr getOutputBufferManager(const std::string &, const std::string &)
+    {
+        Pothos::BufferManagerArgs args;
+        args.bufferSize = std::max(args.bufferSize,
+                          _maxN*2*sizeof(std::complex<float>));
+        return Pothos::BufferManager::make("generic", args);
+    }
+
+private:
+    //configuration
+    const size_t M;
+    size_t P;
+    size_t _maxN;
+    std::vector<float> _taps;
+    kissfft<float> _fft;
+
+    //state
+    std::vector<std::complex<float>> _delayLine;
+    size_t _head;
+    std::vector<std::complex<float>> _fftInput;
+    std::vector<std::complex<float>> _fftOutput;
+    std::vector<std::complex<float> *> _outBuffs;
+};
+
+static Pothos::BlockRegistry registerLoRaChannelizer(
+    "/lora/channelizer", &LoRaChannelizer::make);
@@ -1,3 +1,13 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CODES_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
 /***********************************************************************
  * Defines
  **********************************************************************/
@@ -124,8 +134,9 @@ static inline void SX1232RadioComputeWhitening( uint8_t *buffer, uint16_t buffer
 /***********************************************************************
  *  Whitening generator reverse engineered from Sx1272 data stream.
  *  Each bit of a codeword is combined with the output from a different position in the whitening sequence.
+ *  Returns the whitening of the codeword at a position, the reference for the keystream tables below.
  **********************************************************************/
-static inline void Sx1272ComputeWhitening(uint8_t *buffer, uint16_t bufferSize, const int bitOfs, const int RDD) {
+static inline uint8_t Sx1272WhiteningKey(const size_t position, const size_t RDD) {
 	static const int ofs0[8] = {6,4,2,0,-112,-114,-302,-34 };	// offset into sequence for each bit
 	static const int ofs1[5] = {6,4,2,0,-360 };					// different offsets used for single parity mode (1 == RDD)
 	static const int whiten_len = 510;							// length of whitening sequence
@@ -134,36 +145,78 @@ static inline void Sx1272ComputeWhitening(uint8_t *buffer, uint16_t bufferSize,
 		0x994E0F87E95E2D16L,0x7CBCFC7631984C26L,0x281C8E4F0DAEF7F9L,0x1741886EB7733B15L
 	};
 	const int *ofs = (1 == RDD) ? ofs1 : ofs0;
-	int i, j;
-	for (j = 0; j < bufferSize; j++) {
-		uint8_t x = 0;
-		for (i = 0; i < 4 + RDD; i++) {
-			int t = (ofs[i] + j + bitOfs + whiten_len) % whiten_len;
-			if (whiten_seq[t >> 6] & ((uint64_t)1 << (t & 0x3F))) {
-				x |= 1 << i;
-			}
+	uint8_t x = 0;
+	for (size_t i = 0; i < 4 + RDD; i++) {
+		int t = (ofs[i] + int(position % whiten_len) + whiten_len) % whiten_len;
+		if (whiten_seq[t >> 6] & ((uint64_t)1 << (t & 0x3F))) {
+			x |= 1 << i;
 		}
-		buffer[j] ^= x;
-	}	
+	}
+	return x;
 }
 
 /***********************************************************************
  *  Whitening generator reverse engineered from Sx1272 data stream.
  *  Same as above but using the actual interleaved LFSRs.
+ *  Each LFSR repeats after 255 steps, so the keystream repeats after
+ *  510 codewords: it is generated once per RDD into a table of two periods,
+ *  any start offset is a table index, and packets are whitened with wide XORs.
  **********************************************************************/
-static inline void Sx1272ComputeWhiteningLfsr(uint8_t *buffer, uint16_t bufferSize, const int bitOfs, const size_t RDD) {
-    static const uint64_t seed1[2] = {0x6572D100E85C2EFF,0xE85C2EFFFFFFFFFF};   // lfsr start values
-    static const uint64_t seed2[2] = {0x05121100F8ECFEEF,0xF8ECFEEFEFEFEFEF};   // lfsr start values for single parity mode (1 == RDD)
-    const uint8_t m = 0xff >> (4 - RDD);
-    uint64_t r[2] = {(1 == RDD)?seed2[0]:seed1[0],(1 == RDD)?seed2[1]:seed1[1]};
-    int i,j;
-    for (i = 0; i < bitOfs;i++){
-        r[i & 1] = (r[i & 1] >> 8) | (((r[i & 1] >> 32) ^ (r[i & 1] >> 24) ^ (r[i & 1] >> 16) ^ r[i & 1]) << 56);   // poly: 0x1D
+#define SX1272_WHITENING_PERIOD 510
+
+struct Sx1272WhiteningKeys
+{
+    Sx1272WhiteningKeys(void)
+    {
+        static const uint64_t seed1[2] = {0x6572D100E85C2EFF,0xE85C2EFFFFFFFFFF};   // lfsr start values
+        static const uint64_t seed2[2] = {0x05121100F8ECFEEF,0xF8ECFEEFEFEFEFEF};   // lfsr start values for single parity mode (1 == RDD)
+        for (size_t RDD = 0; RDD <= 4; RDD++)
+        {
+            const uint8_t m = 0xff >> (4 - RDD);
+            uint64_t r[2] = {(1 == RDD)?seed2[0]:seed1[0],(1 == RDD)?seed2[1]:seed1[1]};
+            for (size_t i = 0; i < 2*SX1272_WHITENING_PERIOD; i++)
+            {
+                keys[RDD][i] = r[i & 1] & m;
+                r[i & 1] = (r[i & 1] >> 8) | (((r[i & 1] >> 32) ^ (r[i & 1] >> 24) ^ (r[i & 1] >> 16) ^ r[i & 1]) << 56);   // poly: 0x1D
+            }
+        }
+    }
+
+    uint8_t keys[5][2*SX1272_WHITENING_PERIOD];
+};
+
+//! XOR the keystream of a RDD starting at a codeword position into a buffer
+static inline void Sx1272ApplyWhitening(uint8_t *buffer, size_t bufferSize, const size_t position, const size_t RDD)
+{
+    static const Sx1272WhiteningKeys table;
+    size_t start = position % SX1272_WHITENING_PERIOD;
+    while (bufferSize != 0)
+    {
+        //a run of up to one period stays inside the two period table
+        const size_t n = std::min<size_t>(bufferSize, SX1272_WHITENING_PERIOD);
+        const uint8_t *key = table.keys[RDD] + start;
+        size_t j = 0;
+        for (; j + 8 <= n; j += 8)
+        {
+            uint64_t x, k;
+            std::memcpy(&x, buffer + j, 8);
+            std::memcpy(&k, key + j, 8);
+            x ^= k;
+            std::memcpy(buffer + j, &x, 8);
+        }
+        for (; j < n; j++) buffer[j] ^= key[j];
+        buffer += n;
+        bufferSize -= n;
+        start = (start + n) % SX1272_WHITENING_PERIOD;
     }
-    for (j = 0; j < bufferSize; j++,i++) {
-        buffer[j] ^= r[i & 1] & m;
-        r[i & 1] = (r[i & 1] >> 8) | (((r[i & 1] >> 32) ^ (r[i & 1] >> 24) ^ (r[i & 1] >> 16) ^ r[i & 1]) << 56);
-    }	
+}
+
+static inline void Sx1272ComputeWhitening(uint8_t *buffer, uint16_t bufferSize, const int bitOfs, const int RDD) {
+	Sx1272ApplyWhitening(buffer, bufferSize, size_t(bitOfs % SX1272_WHITENING_PERIOD + SX1272_WHITENING_PERIOD), size_t(RDD));
+}
+
+static inline void Sx1272ComputeWhiteningLfsr(uint8_t *buffer, uint16_t bufferSize, const int bitOfs, const size_t RDD) {
+	Sx1272ApplyWhitening(buffer, bufferSize, size_t(bitOfs % SX1272_WHITENING_PERIOD + SX1272_WHITENING_PERIOD), RDD);
 }
 
 /***********************************************************************
@@ -193,6 +246,148 @@ static inline unsigned short grayToBinary16(unsigned short num)
     return num;
 }
 
+/***********************************************************************
+ * Table driven decoding of the sx1272 codewords:
+ * Each code is described by its syndrome, the data bit to flip
+ * for a syndrome, and the syndromes which cannot be corrected.
+ * The 256 entry tables hold the decoded nibble in bits 0-3,
+ * the parity error flag in bit 4 and the uncorrectable flag in bit 5,
+ * so one load decodes a codeword with all of its flags.
+ **********************************************************************/
+#define CODEWORD_ERROR 0x10
+#define CODEWORD_BAD   0x20
+
+static constexpr unsigned codeBit(const unsigned b, const unsigned i)
+{
+    return (b >> i) & 0x1;
+}
+
+//! No parity bits, the codeword is the data nibble
+struct CodeNone
+{
+    static constexpr unsigned syndrome(const unsigned) {return 0;}
+    static constexpr unsigned correction(const unsigned) {return 0;}
+    static constexpr bool bad(const unsigned) {return false;}
+};
+
+//! Single parity bit of the 5/4 code
+struct CodeParity54
+{
+    static constexpr unsigned syndrome(const unsigned b)
+    {
+        return codeBit(b, 0) ^ codeBit(b, 1) ^ codeBit(b, 2) ^ codeBit(b, 3) ^ codeBit(b, 4);
+    }
+    static constexpr unsigned correction(const unsigned) {return 0;}
+    static constexpr bool bad(const unsigned) {return false;}
+};
+
+//! Two parity bits of the 6/4 code, detection only
+struct CodeParity64
+{
+    static constexpr unsigned syndrome(const unsigned b)
+    {
+        return (codeBit(b, 0) ^ codeBit(b, 1) ^ codeBit(b, 2) ^ codeBit(b, 4)) |
+            ((codeBit(b, 1) ^ codeBit(b, 2) ^ codeBit(b, 3) ^ codeBit(b, 5)) << 1);
+    }
+    static constexpr unsigned correction(const unsigned) {return 0;}
+    static constexpr bool bad(const unsigned) {return false;}
+};
+
+//! Hamming 7/4 with single bit correction of the data bits
+struct CodeHamming74sx
+{
+    static constexpr unsigned syndrome(const unsigned b)
+    {
+        return (codeBit(b, 0) ^ codeBit(b, 1) ^ codeBit(b, 2) ^ codeBit(b, 4)) |
+            ((codeBit(b, 1) ^ codeBit(b, 2) ^ codeBit(b, 3) ^ codeBit(b, 5)) << 1) |
+            ((codeBit(b, 0) ^ codeBit(b, 1) ^ codeBit(b, 3) ^ codeBit(b, 6)) << 2);
+    }
+    static constexpr unsigned correction(const unsigned s)
+    {
+        return (s == 0x5)?1:(s == 0x7)?2:(s == 0x3)?4:(s == 0x6)?8:0;
+    }
+    static constexpr bool bad(const unsigned) {return false;}
+};
+
+//! Hamming 8/4 with single bit correction and double bit detection
+struct CodeHamming84sx
+{
+    static constexpr unsigned syndrome(const unsigned b)
+    {
+        return CodeHamming74sx::syndrome(b) |
+            ((codeBit(b, 0) ^ codeBit(b, 2) ^ codeBit(b, 3) ^ codeBit(b, 7)) << 3);
+    }
+    static constexpr unsigned correction(const unsigned s)
+    {
+        return (s == 0xD)?1:(s == 0x7)?2:(s == 0xB)?4:(s == 0xE)?8:0;
+    }
+    static constexpr bool bad(const unsigned s)
+    {
+        //no error, a parity bit error, or a correctable data bit error
+        return s != 0x0 and s != 0x1 and s != 0x2 and s != 0x4 and s != 0x8 and correction(s) == 0;
+    }
+};
+
+//! The table entry of a codeword
+template <typename Code>
+constexpr uint8_t codewordEntry(const unsigned b)
+{
+    return uint8_t(((b ^ Code::correction(Code::syndrome(b))) & 0xf) |
+        ((Code::syndrome(b) != 0)?CODEWORD_ERROR:0) |
+        (Code::bad(Code::syndrome(b))?CODEWORD_BAD:0));
+}
+
+//compile time index lists to fill the tables
+template <unsigned... Is> struct CodeIndexes {};
+template <unsigned N, unsigned... Is> struct CodeIndexRange : CodeIndexRange<N-1, N-1, Is...> {};
+template <unsigned... Is> struct CodeIndexRange<0, Is...> {typedef CodeIndexes<Is...> type;};
+
+template <typename Code, typename Indexes = typename CodeIndexRange<256>::type> struct CodewordTable;
+
+//! The decode table of all 256 codewords
+template <typename Code, unsigned... Is>
+struct CodewordTable<Code, CodeIndexes<Is...>>
+{
+    static constexpr uint8_t entries[256] = {codewordEntry<Code>(Is)...};
+};
+
+template <typename Code, unsigned... Is>
+constexpr uint8_t CodewordTable<Code, CodeIndexes<Is...>>::entries[256];
+
+template <typename Code, typename Indexes = typename CodeIndexRange<16>::type> struct CodewordNibbleTables;
+
+/*!
+ * The codes are linear: the syndrome of a codeword is the syndrome of
+ * its low nibble xor the syndrome of its high nibble, 16 entry tables
+ * which fit a byte shuffle register decode 16 codewords at once.
+ */
+template <typename Code, unsigned... Is>
+struct CodewordNibbleTables<Code, CodeIndexes<Is...>>
+{
+    static constexpr uint8_t syndromeLo[16] = {uint8_t(Code::syndrome(Is))...};
+    static constexpr uint8_t syndromeHi[16] = {uint8_t(Code::syndrome(Is << 4))...};
+    static constexpr uint8_t correction[16] = {uint8_t(Code::correction(Is))...};
+    static constexpr uint8_t bad[16] = {uint8_t(Code::bad(Is)?CODEWORD_BAD:0)...};
+};
+
+template <typename Code, unsigned... Is>
+constexpr uint8_t CodewordNibbleTables<Code, CodeIndexes<Is...>>::syndromeLo[16];
+template <typename Code, unsigned... Is>
+constexpr uint8_t CodewordNibbleTables<Code, CodeIndexes<Is...>>::syndromeHi[16];
+template <typename Code, unsigned... Is>
+constexpr uint8_t CodewordNibbleTables<Code, CodeIndexes<Is...>>::correction[16];
+template <typename Code, unsigned... Is>
+constexpr uint8_t CodewordNibbleTables<Code, CodeIndexes<Is...>>::bad[16];
+
+//! Decode one codeword from a table, accumulating the flags
+static inline unsigned char decodeCodeword(const uint8_t *table, const unsigned char b, bool &error, bool &bad)
+{
+    const uint8_t x = table[b];
+    if (x & CODEWORD_ERROR) error = true;
+    if (x & CODEWORD_BAD) bad = true;
+    return x & 0xf;
+}
+
 /***********************************************************************
  * Encode a 4 bit word into a 8 bits with parity
  * Non standard version used in sx1272.
@@ -221,35 +416,7 @@ static inline unsigned char encodeHamming84sx(const unsigned char x)
  **********************************************************************/
 static inline unsigned char decodeHamming84sx(const unsigned char b, bool &error, bool &bad)
 {
-    auto b0 = (b >> 0) & 0x1;
-    auto b1 = (b >> 1) & 0x1;
-    auto b2 = (b >> 2) & 0x1;
-    auto b3 = (b >> 3) & 0x1;
-    auto b4 = (b >> 4) & 0x1;
-    auto b5 = (b >> 5) & 0x1;
-    auto b6 = (b >> 6) & 0x1;
-    auto b7 = (b >> 7) & 0x1;
-    
-    auto p0 = (b0 ^ b1 ^ b2 ^ b4);
-    auto p1 = (b1 ^ b2 ^ b3 ^ b5);
-    auto p2 = (b0 ^ b1 ^ b3 ^ b6);
-    auto p3 = (b0 ^ b2 ^ b3 ^ b7);
-    
-    auto parity = (p0 << 0) | (p1 << 1) | (p2 << 2) | (p3 << 3);
-    if (parity != 0) error = true;
-    switch (parity & 0xf)
-    {
-        case 0xD: return (b ^ 1) & 0xf;
-        case 0x7: return (b ^ 2) & 0xf;
-        case 0xB: return (b ^ 4) & 0xf;
-        case 0xE: return (b ^ 8) & 0xf;
-        case 0x0:
-        case 0x1:
-        case 0x2:
-        case 0x4:
-        case 0x8: return b & 0xf;
-        default: bad = true; return b & 0xf;
-    }
+    return decodeCodeword(CodewordTable<CodeHamming84sx>::entries, b, error, bad);
 }
 
 /***********************************************************************
@@ -277,32 +444,8 @@ static inline unsigned char encodeHamming74sx(const unsigned char x)
  **********************************************************************/
 static inline unsigned char decodeHamming74sx(const unsigned char b, bool &error)
 {
-    auto b0 = (b >> 0) & 0x1;
-    auto b1 = (b >> 1) & 0x1;
-    auto b2 = (b >> 2) & 0x1;
-    auto b3 = (b >> 3) & 0x1;
-    auto b4 = (b >> 4) & 0x1;
-    auto b5 = (b >> 5) & 0x1;
-    auto b6 = (b >> 6) & 0x1;
-    
-    auto p0 = (b0 ^ b1 ^ b2 ^ b4);
-    auto p1 = (b1 ^ b2 ^ b3 ^ b5);
-    auto p2 = (b0 ^ b1 ^ b3 ^ b6);
-    
-    auto parity = (p0 << 0) | (p1 << 1) | (p2 << 2);
-    if (parity != 0) error = true;
-    switch (parity)
-    {
-        case 0x5: return (b ^ 1) & 0xf;
-        case 0x7: return (b ^ 2) & 0xf;
-        case 0x3: return (b ^ 4) & 0xf;
-        case 0x6: return (b ^ 8) & 0xf;
-        case 0x0:
-        case 0x1:
-        case 0x2:
-        case 0x4: return b & 0xF;
-    }
-    return b & 0xf;
+    bool bad = false;
+    return decodeCodeword(CodewordTable<CodeHamming74sx>::entries, b, error, bad);
 }
 
 /***********************************************************************
@@ -310,10 +453,8 @@ static inline unsigned char decodeHamming74sx(const unsigned char b, bool &error
  * return true if parity is valid.
  **********************************************************************/
 static inline unsigned char checkParity54(const unsigned char b, bool &error) {
-	auto x = b ^ (b >> 2);
-	x = x ^ (x >> 1) ^ (b >> 4);
-	if (x & 1) error = true;
-	return b & 0xf;
+	bool bad = false;
+	return decodeCodeword(CodewordTable<CodeParity54>::entries, b, error, bad);
 }
 
 static inline unsigned char encodeParity54(const unsigned char b) {
@@ -327,13 +468,8 @@ static inline unsigned char encodeParity54(const unsigned char b) {
 * return true if parity is valid.
 **********************************************************************/
 static inline unsigned char checkParity64(const unsigned char b, bool &error) {
-	auto x = b ^ (b >> 1) ^ (b >> 2);
-	auto y = x ^ b ^ (b >> 3);
-	
-	x ^= b >> 4;
-	y ^= b >> 5;
-	if ((x | y) & 1) error = true;
-	return b & 0xf;
+	bool bad = false;
+	return decodeCodeword(CodewordTable<CodeParity64>::entries, b, error, bad);
 }
 
 static inline unsigned char encodeParity64(const unsigned char b) {
@@ -342,53 +478,188 @@ static inline unsigned char encodeParity64(const unsigned char b) {
 	return ((x & 1) << 4) | ((y & 1) << 5) | (b & 0xf);
 }
 
+/***********************************************************************
+ * Decode the codewords of the payload into bytes, two per byte with the
+ * low nibble first, for the coding rates RDD 0 (no parity) to 4 (hamming 8/4).
+ * The error and bad flags accumulate like the single codeword decoders.
+ **********************************************************************/
+typedef void (*CodewordDecoder)(const uint8_t *codewords, uint8_t *bytes, const size_t numBytes,
+    const size_t RDD, bool &error, bool &bad);
+
+//! The decode table of a coding rate
+static inline const uint8_t *codewordTableSx(const size_t RDD)
+{
+    switch (RDD)
+    {
+        case 1: return CodewordTable<CodeParity54>::entries;
+        case 2: return CodewordTable<CodeParity64>::entries;
+        case 3: return CodewordTable<CodeHamming74sx>::entries;
+        case 4: return CodewordTable<CodeHamming84sx>::entries;
+        default: return CodewordTable<CodeNone>::entries;
+    }
+}
+
+//! Portable codeword decoder, one table load per codeword
+static inline void decodeCodewordsScalar(const uint8_t *codewords, uint8_t *bytes, const size_t numBytes,
+    const size_t RDD, bool &error, bool &bad)
+{
+    const uint8_t *table = codewordTableSx(RDD);
+    uint8_t flags = 0;
+    for (size_t i = 0; i < numBytes; i++)
+    {
+        const uint8_t lo = table[codewords[2*i]];
+        const uint8_t hi = table[codewords[2*i+1]];
+        flags |= lo | hi;
+        bytes[i] = uint8_t((lo & 0xf) | (hi << 4));
+    }
+    if (flags & CODEWORD_ERROR) error = true;
+    if (flags & CODEWORD_BAD) bad = true;
+}
+
+#ifdef CODES_X86_DISPATCH
+
+//! SSSE3 decoder of one code, 16 codewords into 8 bytes per iteration
+//! \return the number of bytes decoded, the remainder is left for the scalar decoder
+template <typename Code>
+__attribute__((target("ssse3")))
+static inline size_t decodeCodewordsSsse3Code(const uint8_t *codewords, uint8_t *bytes, const size_t numBytes, uint8_t &flags)
+{
+    typedef CodewordNibbleTables<Code> Tables;
+    const __m128i syndromeLo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Tables::syndromeLo));
+    const __m128i syndromeHi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Tables::syndromeHi));
+    const __m128i correction = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Tables::correction));
+    const __m128i badTable = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Tables::bad));
+    const __m128i nibble = _mm_set1_epi8(0xf);
+    const __m128i pack = _mm_set1_epi16(0x1001); //lo*1 + hi*16
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= numBytes; i += 8)
+    {
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(codewords + 2*i));
+        const __m128i lo = _mm_and_si128(b, nibble);
+        const __m128i hi = _mm_and_si128(_mm_srli_epi16(b, 4), nibble);
+        const __m128i syndrome = _mm_xor_si128(_mm_shuffle_epi8(syndromeLo, lo), _mm_shuffle_epi8(syndromeHi, hi));
+        const __m128i data = _mm_xor_si128(lo, _mm_shuffle_epi8(correction, syndrome));
+        acc = _mm_or_si128(acc, _mm_or_si128(syndrome, _mm_shuffle_epi8(badTable, syndrome)));
+        const __m128i words = _mm_maddubs_epi16(data, pack);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(bytes + i), _mm_packus_epi16(words, words));
+    }
+    uint8_t accs[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(accs), acc);
+    for (size_t j = 0; j < 16; j++)
+    {
+        if (accs[j] & 0xf) flags |= CODEWORD_ERROR;
+        flags |= accs[j] & CODEWORD_BAD;
+    }
+    return i;
+}
+
+//! SSSE3 codeword decoder: the syndromes, corrections and flags
+//! come from byte shuffles of the 16 entry nibble tables of the code
+__attribute__((target("ssse3")))
+static inline void decodeCodewordsSsse3(const uint8_t *codewords, uint8_t *bytes, const size_t numBytes,
+    const size_t RDD, bool &error, bool &bad)
+{
+    uint8_t flags = 0;
+    size_t i = 0;
+    switch (RDD)
+    {
+        case 1: i = decodeCodewordsSsse3Code<CodeParity54>(codewords, bytes, numBytes, flags); break;
+        case 2: i = decodeCodewordsSsse3Code<CodeParity64>(codewords, bytes, numBytes, flags); break;
+        case 3: i = decodeCodewordsSsse3Code<CodeHamming74sx>(codewords, bytes, numBytes, flags); break;
+        case 4: i = decodeCodewordsSsse3Code<CodeHamming84sx>(codewords, bytes, numBytes, flags); break;
+        default: i = decodeCodewordsSsse3Code<CodeNone>(codewords, bytes, numBytes, flags); break;
+    }
+    if (flags & CODEWORD_ERROR) error = true;
+    if (flags & CODEWORD_BAD) bad = true;
+    decodeCodewordsScalar(codewords + 2*i, bytes + i, numBytes - i, RDD, error, bad);
+}
+
+#endif //CODES_X86_DISPATCH
+
+//! Select the fastest codeword decoder supported by the running CPU
+static inline CodewordDecoder getCodewordDecoder(void)
+{
+    #ifdef CODES_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3")) return &decodeCodewordsSsse3;
+    #endif //CODES_X86_DISPATCH
+    return &decodeCodewordsScalar;
+}
+
 /***********************************************************************
  * Diagonal interleaver + deinterleaver
+ * A block of PPM codewords of 4+RDD bits is a bit matrix with a codeword
+ * per row: symbol k is column k rotated right by k within the PPM bits.
+ * The block is moved with two 8x8 bit matrix transposes for the up to
+ * 16 rows and one rotate per symbol instead of one shift per bit.
  **********************************************************************/
-static inline void diagonalInterleaveSx(const uint8_t *codewords, const size_t numCodewords, uint16_t *symbols, const size_t PPM, const size_t RDD){
-	for (size_t x = 0; x < numCodewords / PPM; x++)	{
-		const size_t cwOff = x*PPM;
-		const size_t symOff = x*(4 + RDD);
-		for (size_t k = 0; k < 4 + RDD; k++){
-			for (size_t m = 0; m < PPM; m++){
-				const size_t i = (m + k + PPM) % PPM;
-				const auto bit = (codewords[cwOff + i] >> k) & 0x1;
-				symbols[symOff + k] |= (bit << m);
-			}
-		}
-	}
+//! Transpose an 8x8 bit matrix: bit c of byte r moves to bit r of byte c
+static inline uint64_t transposeBits8x8(uint64_t x)
+{
+    uint64_t t;
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;
+    x ^= t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull;
+    x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull;
+    x ^= t ^ (t << 28);
+    return x;
 }
 
-static inline void diagonalDeterleaveSx(const uint16_t *symbols, const size_t numSymbols, uint8_t *codewords, const size_t PPM, const size_t RDD)
+//! Rotate the PPM bits of x by r < PPM bits
+static inline unsigned rotateRightPPM(const unsigned x, const size_t r, const size_t PPM)
 {
-	for (size_t x = 0; x < numSymbols / (4 + RDD); x++)
-	{
-		const size_t cwOff = x*PPM;
-		const size_t symOff = x*(4 + RDD);
-		for (size_t k = 0; k < 4 + RDD; k++)
-		{
-			for (size_t m = 0; m < PPM; m++)
-			{
-				const size_t i = (m + k) % PPM;
-				const auto bit = (symbols[symOff + k] >> m) & 0x1;
-				codewords[cwOff + i] |= (bit << k);
-			}
-		}
-	}
+    return ((x >> r) | (x << (PPM - r))) & ((1u << PPM) - 1);
 }
 
-static inline void diagonalDeterleaveSx2(const uint16_t *symbols, const size_t numSymbols, uint8_t *codewords, const size_t PPM, const size_t RDD){
-	size_t nb = RDD + 4;
-	for (size_t x = 0; x < numSymbols / nb; x++) {
-		const size_t cwOff = x*PPM;
-		const size_t symOff = x*nb;
-		for (size_t m = 0; m < PPM; m++) {
-			size_t i = m;
-			auto sym = symbols[symOff + m];
-			for (size_t k = 0; k < PPM; k++, sym >>= 1) {
-				codewords[cwOff + i] |= (sym & 1) << m;
-				if (++i == PPM) i = 0;
-			}
-		}
-	}
+static inline unsigned rotateLeftPPM(const unsigned x, const size_t r, const size_t PPM)
+{
+    return ((x << r) | (x >> (PPM - r))) & ((1u << PPM) - 1);
+}
+
+static inline void diagonalInterleaveSx(const uint8_t *codewords, const size_t numCodewords, uint16_t *symbols, const size_t PPM, const size_t RDD)
+{
+    //the rotation of each symbol, codewords have no bits past the 8th
+    const size_t nb = (RDD < 4)?(4 + RDD):8;
+    size_t rot[8];
+    for (size_t k = 0; k < nb; k++) rot[k] = k % PPM;
+
+    for (size_t x = 0; x < numCodewords / PPM; x++)
+    {
+        const uint8_t *cw = codewords + x*PPM;
+        uint16_t *sym = symbols + x*(4 + RDD);
+        uint64_t rows[2] = {0, 0};
+        for (size_t i = 0; i < PPM; i++) rows[i >> 3] |= uint64_t(cw[i]) << ((i & 7)*8);
+        const uint64_t lo = transposeBits8x8(rows[0]);
+        const uint64_t hi = transposeBits8x8(rows[1]);
+        for (size_t k = 0; k < nb; k++)
+        {
+            const unsigned column = unsigned((lo >> (8*k)) & 0xff) | (unsigned((hi >> (8*k)) & 0xff) << 8);
+            sym[k] |= uint16_t(rotateRightPPM(column, rot[k], PPM));
+        }
+    }
+}
+
+static inline void diagonalDeterleaveSx(const uint16_t *symbols, const size_t numSymbols, uint8_t *codewords, const size_t PPM, const size_t RDD)
+{
+    const size_t nb = (RDD < 4)?(4 + RDD):8;
+    size_t rot[8];
+    for (size_t k = 0; k < nb; k++) rot[k] = k % PPM;
+    const unsigned mask = (1u << PPM) - 1;
+
+    for (size_t x = 0; x < numSymbols / (4 + RDD); x++)
+    {
+        const uint16_t *sym = symbols + x*(4 + RDD);
+        uint8_t *cw = codewords + x*PPM;
+        uint64_t lo = 0, hi = 0;
+        for (size_t k = 0; k < nb; k++)
+        {
+            const unsigned column = rotateLeftPPM(sym[k] & mask, rot[k], PPM);
+            lo |= uint64_t(column & 0xff) << (8*k);
+            hi |= uint64_t(column >> 8) << (8*k);
+        }
+        const uint64_t rows[2] = {transposeBits8x8(lo), transposeBits8x8(hi)};
+        for (size_t i = 0; i < PPM; i++) cw[i] |= uint8_t(rows[i >> 3] >> ((i & 7)*8));
+    }
 }
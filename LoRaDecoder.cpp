@@ -6,6 +6,10 @@
 #include <iostream>
 #include <cstring>
 #include "LoRaCodes.hpp"
+#include "LoRaStats.hpp"
+#include <json.hpp>
+
+using json = nlohmann::json;
 
 /***********************************************************************
  * |PothosDoc LoRa Decoder
@@ -20,11 +24,20 @@
  * A packet message with a payload containing LoRa modulation symbols.
  * The format of the packet payload is a buffer of unsigned shorts.
  * A 16-bit short can fit all size symbols from 7 to 12 bits.
+ * The "sf" metadata field when present overrides the spread factor.
  *
  * <h2>Output format</h2>
  *
  * A packet message with a payload containing bytes received.
  *
+ * <h2>Statistics</h2>
+ *
+ * The getStats() call returns a JSON object with the packets and symbols received,
+ * the packets and bytes decoded, and the dropped packets by reason:
+ * too short for a header, bad header checksum, unknown coding rate,
+ * length beyond the payload, uncorrectable FEC errors, or a CRC mismatch.
+ * The "ticks" object splits the work time into deinterleaving and decoding.
+ *
  * |category /LoRa
  * |keywords lora
  *
@@ -106,8 +119,10 @@ public:
 		_explicit(true),
         _hdr(false),
 		_dataLength(8),
-        _dropped(0)
+        _dropped(0),
+        _decodeCodewords(getCodewordDecoder())
     {
+        this->resetStats();
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDecoder, setSpreadFactor));
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDecoder, setSymbolSize));
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDecoder, setCodingRate));
@@ -119,6 +134,8 @@ public:
 		this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDecoder, setDataLength));
 		this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDecoder, enableErrorCheck));
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDecoder, getDropped));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDecoder, getStats));
+        loraTicksPerSecond();
 
         this->registerSignal("dropped");
         this->setupInput("0");
@@ -187,9 +204,27 @@ public:
         return _dropped;
     }
 
+    std::string getStats(void) const
+    {
+        static const char *dropNames[NUM_DROP_REASONS] = {"short", "header", "codingRate", "length", "fec", "crc"};
+        json stats;
+        stats["packets"] = _packets;
+        stats["symbols"] = _symbols;
+        stats["packetsDecoded"] = _packetsDecoded;
+        stats["bytes"] = _bytes;
+        stats["dropped"] = _dropped;
+        for (size_t i = 0; i < NUM_DROP_REASONS; i++) stats["drops"][dropNames[i]] = _drops[i];
+        stats["ticks"]["deinterleave"] = _deinterleaveTicks;
+        stats["ticks"]["decode"] = _workTicks - _deinterleaveTicks;
+        stats["ticks"]["work"] = _workTicks;
+        stats["ticksPerSecond"] = loraTicksPerSecond();
+        return stats.dump();
+    }
+
     void activate(void)
     {
         _dropped = 0;
+        this->resetStats();
         this->emitSignal("dropped", _dropped);
     }
 
@@ -198,14 +233,21 @@ public:
 		auto outPort = this->output(0);
 		if (not inPort->hasMessage()) return;
 
-		const size_t PPM = (_ppm == 0) ? _sf : _ppm;
-		if (PPM > _sf) throw Pothos::Exception("LoRaDecoder::work()", "failed check: PPM <= SF");
-
 		//extract the input symbols
 		auto msg = inPort->popMessage();
 		auto pkt = msg.extract<Pothos::Packet>();
+		LoRaPhaseTimer timer(_workTicks);
+		_packets++;
+		_symbols += pkt.payload.elements();
         
-        if (pkt.payload.elements() < N_HEADER_SYMBOLS) return; // need at least a header
+        if (pkt.payload.elements() < N_HEADER_SYMBOLS) return this->drop(DROP_SHORT); // need at least a header
+
+		//a multi-SF demodulator tags each packet with its spread factor
+		const auto sfIt = pkt.metadata.find("sf");
+		const size_t sf = (sfIt == pkt.metadata.end()) ? _sf : sfIt->second.convert<size_t>();
+
+		const size_t PPM = (_ppm == 0) ? sf : _ppm;
+		if (PPM > sf) throw Pothos::Exception("LoRaDecoder::work()", "failed check: PPM <= SF");
         
 		const size_t numSymbols = roundUp(pkt.payload.elements(), 4 + _rdd);
 		const size_t numCodewords = (numSymbols / (4 + _rdd))*PPM;
@@ -213,11 +255,12 @@ public:
 		std::memcpy(symbols.data(), pkt.payload.as<const void *>(), pkt.payload.length);
 
         int rdd = _rdd; //make a copy to be changed in header decode
+		const auto ticks0 = loraTicks();
 
 		//gray encode, when SF > PPM, depad the LSBs with rounding
 		for (auto &sym : symbols){
-			sym += (1 << (_sf - PPM)) / 2; //increment by 1/2
-			sym >>= (_sf - PPM); //down shift to PPM bits
+			sym += (1 << (sf - PPM)) / 2; //increment by 1/2
+			sym >>= (sf - PPM); //down shift to PPM bits
 			sym = binaryToGray16(sym);
 		}
 		//deinterleave / dewhiten the symbols into codewords
@@ -266,8 +309,10 @@ public:
 			out.payload = Pothos::BufferChunk(typeid(uint16_t), numSymbols);
 			std::memcpy(out.payload.as<void *>(), symbols.data(), out.payload.length);
 			outPort->postMessage(out);
+			_packetsDecoded++;
 			return;
 		}
+		_deinterleaveTicks += loraTicks() - ticks0;
 
 		bool error = false;
 		bool bad = false;
@@ -290,11 +335,11 @@ public:
 			
 			bytes[2] ^= headerChecksum(bytes.data());
 
-			if (error && _errorCheck) return this->drop();
+			if (error && _errorCheck) return this->drop(DROP_HEADER);
             
             if (0 == (bytes[1] & 1)) checkCrc = false;	// disable crc check if not present in the packet
             rdd = (bytes[1] >> 1) & 0x7;				// header contains error correction info
-            if (rdd > 4) return this->drop();
+            if (rdd > 4) return this->drop(DROP_CODING_RATE);
             
             packetLength = bytes[0];
             dataLength = packetLength + ((bytes[1] & 1)?5:3);  // include  header and crc
@@ -310,7 +355,7 @@ public:
             }
         }
         
-        if (dataLength > bytes.size()) return this->drop();
+        if (dataLength > bytes.size()) return this->drop(DROP_LENGTH);
 		
 		for (; cOfs < PPM; cOfs++, dOfs++) {
 			if (dOfs & 1)
@@ -339,28 +384,13 @@ public:
 		}
 		dOfs >>= 1;
 
-		if (error && _errorCheck) return this->drop();
+		if (error && _errorCheck) return this->drop(DROP_FEC);
 
 
 		//decode each codeword as 2 bytes with correction
-		if (rdd == 0) for (size_t i = dOfs; i < dataLength; i++) {
-			bytes[i] = codewords[cOfs++] & 0xf;
-			bytes[i] |= codewords[cOfs++] << 4;
-		}else if (rdd == 1) for (size_t i = dOfs; i < dataLength; i++) {
-			bytes[i] = checkParity54(codewords[cOfs++],error);
-			bytes[i] |= checkParity54(codewords[cOfs++], error) << 4;
-		}else if (rdd == 2) for (size_t i = dOfs; i < dataLength; i++) {
-			bytes[i] = checkParity64(codewords[cOfs++], error);
-			bytes[i] |= checkParity64(codewords[cOfs++],error) << 4;
-		}else if (rdd == 3) for (size_t i = dOfs; i < dataLength; i++){
-			bytes[i] = decodeHamming74sx(codewords[cOfs++], error) & 0xf;
-			bytes[i] |= decodeHamming74sx(codewords[cOfs++], error) << 4;
-		}else if (rdd == 4) for (size_t i = dOfs; i < dataLength; i++){
-			bytes[i] = decodeHamming84sx(codewords[cOfs++], error, bad) & 0xf;
-			bytes[i] |= decodeHamming84sx(codewords[cOfs++], error, bad) << 4;
-		}
+		if (dOfs < dataLength) _decodeCodewords(codewords.data() + cOfs, bytes.data() + dOfs, dataLength - dOfs, rdd, error, bad);
 		
-		if (error && _errorCheck) return this->drop();
+		if (error && _errorCheck) return this->drop(DROP_FEC);
         
         dOfs = 0;
         
@@ -368,20 +398,20 @@ public:
 			if (bytes[1] & 1) {							// always compute crc if present
 				uint16_t crc = sx1272DataChecksum(bytes.data() + 3, packetLength);
 				uint16_t packetCrc = bytes[3 + packetLength] | (bytes[4 + packetLength] << 8);
-				if (crc != packetCrc && checkCrc) return this->drop();
+				if (crc != packetCrc && checkCrc) return this->drop(DROP_CRC);
 				bytes[3 + packetLength] ^= crc;
 				bytes[4 + packetLength] ^= (crc >> 8);
 			}
             if (!_hdr){
                 dOfs = 3;
-                dataLength -= 5;
+                dataLength = packetLength;
             }
 		}
 		else {
             if (checkCrc) {
                 uint16_t crc = sx1272DataChecksum(bytes.data(), _dataLength);
                 uint16_t packetCrc = bytes[_dataLength] | (bytes[_dataLength + 1] << 8);
-                if (crc != packetCrc) return this->drop();
+                if (crc != packetCrc) return this->drop(DROP_CRC);
                 bytes[_dataLength + 0] ^= crc;
                 bytes[_dataLength + 1] ^= (crc >> 8);
             }
@@ -392,18 +422,44 @@ public:
 		out.payload = Pothos::BufferChunk(typeid(uint8_t), dataLength);
 		std::memcpy(out.payload.as<void *>(), bytes.data()+dOfs, out.payload.length);
 		outPort->postMessage(out);
+		_packetsDecoded++;
+		_bytes += out.payload.length;
 		return;
 
     }
 
 private:
 
-    void drop(void)
+    //! Reasons to drop a packet, counted separately in getStats()
+    enum DropReason
+    {
+        DROP_SHORT,
+        DROP_HEADER,
+        DROP_CODING_RATE,
+        DROP_LENGTH,
+        DROP_FEC,
+        DROP_CRC,
+        NUM_DROP_REASONS
+    };
+
+    void drop(const DropReason reason)
     {
         _dropped++;
+        _drops[reason]++;
         this->emitSignal("dropped", _dropped);
     }
 
+    void resetStats(void)
+    {
+        _packets = 0;
+        _symbols = 0;
+        _packetsDecoded = 0;
+        _bytes = 0;
+        for (auto &drops : _drops) drops = 0;
+        _deinterleaveTicks = 0;
+        _workTicks = 0;
+    }
+
     size_t _sf;
     size_t _ppm;
     size_t _rdd;
@@ -415,6 +471,14 @@ private:
     bool _hdr;
 	size_t _dataLength;
     unsigned long long _dropped;
+    CodewordDecoder _decodeCodewords;
+    unsigned long long _packets;
+    unsigned long long _symbols;
+    unsigned long long _packetsDecoded;
+    unsigned long long _bytes;
+    unsigned long long _drops[NUM_DROP_REASONS];
+    unsigned long long _deinterleaveTicks;
+    unsigned long long _workTicks;
 };
 
 static Pothos::BlockRegistry registerLoRaDecoder(
@@ -5,8 +5,137 @@
 #include <iostream>
 #include <complex>
 #include <cstring>
+#include <cstdio>
 #include <cmath>
+#include <algorithm>
 #include "LoRaDetector.hpp"
+#include "DechirpKernel.hpp"
+#include "ChirpTables.hpp"
+#include "LoRaStats.hpp"
+#include "LoRaCapture.hpp"
+#include <json.hpp>
+#include <memory>
+
+using json = nlohmann::json;
+
+/***********************************************************************
+ * Demodulator state for a single packet context of a spread factor:
+ * The shared chirp tables, detector, and frame sync state machine,
+ * and the read offset of this tracker into the shared input buffer.
+ * Offsets are at the input rate of NN = N*ovs samples per symbol,
+ * the chirp tables and detector are at the chip rate of N points per symbol.
+ **********************************************************************/
+struct LoRaDemodTracker
+{
+    LoRaDemodTracker(const size_t sf, const size_t ovs, const std::string &fft):
+        sf(sf),
+        N(1 << sf),
+        ovs(ovs),
+        NN(N*ovs),
+        _tables(getChirpTables(sf, ovs)),
+        _detector(N, fft, BATCH_POINTS/N),
+        _offset(0),
+        _symCount(0),
+        _dataStart(0),
+        _softCount(0),
+        _prevValue(0),
+        _freqError(0),
+        _freqErrorFrac(0.0f),
+        _finePhasor(1.0f),
+        _finefreqError(0.0),
+        _noiseFloor(0.0f),
+        _upchirps(0),
+        _active(true),
+        _trackedPower(0.0f),
+        _runnerUp(0),
+        _margin(0.0f),
+        _gatedBlocks(0)
+    {
+        _state = STATE_FRAMESYNC;
+        _chirpTable = _tables->up.data();
+    }
+
+    //! The fine tune phase rotation per chip for the current error
+    std::complex<float> fineTuneRotation(void) const
+    {
+        return std::complex<float>(std::polar(1.0, -2*M_PI*_finefreqError/N));
+    }
+
+    //! Payload symbols are transformed in batches of BATCH_POINTS FFT points:
+    //! 16 symbols at SF7 down to one symbol from SF11, where the FFT dominates anyway
+    static const size_t BATCH_POINTS = 2048;
+    static const size_t MAX_BATCH = BATCH_POINTS >> 7;
+
+    //configuration
+    size_t sf;
+    size_t N;
+    size_t ovs;
+    size_t NN;
+    std::shared_ptr<const ChirpTables> _tables;
+    LoRaDetector<float> _detector;
+    const std::complex<float> *_chirpTable;
+
+    //state
+    enum LoraDemodState
+    {
+        STATE_FRAMESYNC,
+        STATE_DOWNCHIRP0,
+        STATE_DOWNCHIRP1,
+        STATE_QUARTERCHIRP,
+        STATE_DATASYMBOLS,
+    };
+    LoraDemodState _state;
+    size_t _offset;
+    size_t _symCount;
+    unsigned long long _dataStart;
+    Pothos::BufferChunk _outSymbols;
+    Pothos::BufferChunk _outSoft;
+    size_t _softCount;
+    std::string _id;
+    short _prevValue;
+    int _freqError;
+    float _freqErrorFrac;
+    std::complex<float> _finePhasor;
+    float _finefreqError;
+    float _noiseFloor;
+    size_t _upchirps; //consecutive preamble symbols seen during frame sync
+    bool _active;
+    float _trackedPower;
+    size_t _runnerUp; //second choice for the last payload symbol, see assignPeak()
+    float _margin; //the extra cost of the second choice
+    float _blockEnergy[4];
+    size_t _gatedBlocks;
+};
+
+//! Runtime counters of the demodulator over all trackers, reset on activate
+//! The dechirp and fft ticks are sampled, see loraTimerSample()
+struct LoRaDemodStats
+{
+    unsigned long long samples = 0;
+    unsigned long long symbols = 0;
+    unsigned long long packets = 0;
+    unsigned long long transforms = 0;
+    unsigned long long gatedHops = 0;
+    unsigned long long preambles = 0;
+    unsigned long long falseAlarms = 0;
+    unsigned long long squelchEnds = 0;
+    unsigned long long mtuEnds = 0;
+    unsigned long long chunkAllocs = 0;
+    unsigned long long dechirpTicks = 0;
+    unsigned long long fftTicks = 0;
+    unsigned long long workTicks = 0;
+    unsigned long long timerCalls = 0;
+};
+
+//! The bins other contexts attribute to their packets in a window, see claimedPeaks()
+struct LoRaPeakClaims
+{
+    static const size_t MAX_CLAIMS = 16;
+    size_t num = 0;
+    float bins[MAX_CLAIMS];
+    float weights[MAX_CLAIMS];
+    LoRaDemodTracker *owners[MAX_CLAIMS];
+};
 
 /***********************************************************************
  * |PothosDoc LoRa Demod
@@ -15,30 +144,82 @@
  *
  * <h2>Input format</h2>
  *
- * The input port 0 accepts a complex sample stream of modulated chirps
+ * The input port 0 accepts a complex float sample stream of modulated chirps
  * received at the specified bandwidth and carrier frequency.
+ * The LoRa Demod (typed) block takes CS16 and CS8 input instead.
+ * When oversampled, each group of ovs input samples is averaged
+ * down to one chip in the same pass as the dechirp before the FFT.
  *
  * <h2>Output format</h2>
  *
  * The output port 0 produces a packet containing demodulated symbols.
  * The format of the packet payload is a buffer of unsigned shorts.
  * A 16-bit short can fit all size symbols from 7 to 12 bits.
+ * The packet metadata contains the spread factor of the symbols as "sf".
+ *
+ * When soft output is enabled, the packet metadata also contains "soft":
+ * a buffer of signed shorts with K pairs of (bin, level) per symbol,
+ * the K strongest FFT bins of the symbol in order of descending power.
+ * The level is the bin power relative to the noise power in 1/100 dB,
+ * the same scale as the threshold parameter.
+ * The bins use the same symbol mapping as the hard decision payload,
+ * so a decoder can weigh or substitute candidate symbols without the FFT.
  *
  * <h2>Debug port raw</h2>
  *
  * The raw debug port outputs the LoRa signal annotated with labels
  * for important synchronization points in the input sample stream.
+ * The raw samples have the same data type as the input port.
  *
  * <h2>Debug port dec</h2>
  *
  * The dec debug port outputs the LoRa signal downconverted
  * by a locally generated chirp with the same annotation labels as the raw output.
+ * When oversampled, the dec output is at the decimated rate.
+ *
+ * <h2>Debug port fft</h2>
+ *
+ * The fft debug port outputs the spectrum of each dechirped symbol.
+ *
+ * The debug ports are written while the debug ports setting is on.
+ * Turn it off in a headless deployment: the demodulator then skips
+ * the debug copies and label formatting and batches the payload symbols.
+ *
+ * <h2>Statistics</h2>
+ *
+ * The getStats() call returns a JSON object of counters since activation:
+ * samples consumed, payload symbols, packets and how they ended (squelch or MTU),
+ * FFTs run, search hops skipped by the energy gate, preambles locked,
+ * and false alarms where the first sync word matched but the second did not.
+ * The "ticks" object splits the work time into dechirp, FFT and peak search,
+ * and the remaining state machine, "ticksPerSecond" converts them to seconds.
+ * The work ticks are exact, the dechirp and FFT ticks are sampled
+ * on one call in 16 and scaled, so that the timers stay cheap at SF7.
+ *
+ * <h2>Capture</h2>
+ *
+ * When a capture path is set, the demodulator keeps twice the capture time
+ * of input samples in a ring buffer allocated on activation.
+ * A trigger writes the window centered on it as a SigMF recording
+ * named after the capture path and a sequence number,
+ * with the SYNC, DC, QC and END points of the packets as annotations.
+ * A background thread copies the window out of the ring and writes it,
+ * so the work only copies the input into the ring and never waits on the disk.
+ * A trigger while both capture slots are still busy is dropped and counted,
+ * as is a window the ring overwrote before the background thread copied it.
+ * Triggers inside the window of a pending capture only annotate it.
+ * Connect the "dropped" signal of the LoRa Decoder to the captureDrop slot
+ * to capture the packets which fail to decode, or call triggerCapture().
+ * Set the capture time to at least twice the longest packet, so that the
+ * window around a sync or a drop holds the whole packet.
  *
  * |category /LoRa
  * |keywords lora
  *
  * |param sf[Spread factor] The spreading factor controls the symbol spread.
  * Each symbol will occupy 2^SF number of samples given the waveform BW.
+ * Changing the spread factor at runtime swaps in the shared chirp tables
+ * and restarts the preamble search without rebuilding the block.
  * |default 10
  *
  * |param sync[Sync word] The sync word is a 2-nibble, 2-symbol sync value.
@@ -57,28 +238,162 @@
  * |units symbols
  * |default 256
  *
+ * |param sfs[Spread factors] Additional spread factors to demodulate in parallel.
+ * The input stream is buffered once and each spread factor runs its own
+ * preamble search and symbol tracking over the shared input buffer.
+ * Output packets carry the spread factor in the "sf" metadata field.
+ * The debug ports and signals only refer to the primary spread factor.
+ * An empty list demodulates the primary spread factor only.
+ * |default []
+ * |preview valid
+ *
+ * |param ovs[Oversampling ratio] The number of input samples per chip.
+ * |default 1
+ *
+ * |param gate[Energy gate] The energy pre-detector level in dB above the noise floor.
+ * While idle, the preamble search measures the mean energy of each symbol
+ * and only runs the FFT based detector when the energy exceeds the running
+ * noise floor estimate by this amount. This saves most of the CPU on idle channels,
+ * but packets received below the noise floor add little energy and may be missed.
+ * A level of 0 dB disables the pre-detector and runs the FFT for every symbol.
+ * |units dB
+ * |default 0.0
+ * |preview valid
+ *
+ * |param searchHop[Search hop] The step of the preamble search over idle input as a fraction of a symbol.
+ * While the search only sees noise, either below the threshold or skipped by the energy gate,
+ * it slides its window by this step rather than a full symbol. The first window which
+ * overlaps a preamble is found sooner, so packets with short preambles still lock.
+ * The energy gate only measures the new part of each overlapping window.
+ * Shorter steps run more FFTs on an idle channel unless the energy gate is used.
+ * |option [Full symbol] 1
+ * |option [Half symbol] 2
+ * |option [Quarter symbol] 4
+ * |default 1
+ * |preview valid
+ *
+ * |param contexts[Packet contexts] The number of packets per spread factor to track at once.
+ * One context per spread factor runs the preamble search. When it finds a packet,
+ * it keeps tracking that packet and an idle context takes over the search,
+ * so a second packet which starts in the middle of the first is not lost.
+ * While several packets of a spread factor overlap, each context picks
+ * the FFT peak closest to the power of its own packet rather than the strongest one.
+ * |default 1
+ * |preview valid
+ *
+ * |param soft[Soft candidates] The number of candidate bins K per symbol in the soft output.
+ * The demodulator already computes the spectrum of each symbol for the hard decision,
+ * the soft output keeps the strongest bins and their levels for a soft decision decoder.
+ * A value of 0 disables the soft output.
+ * |default 0
+ * |preview valid
+ *
+ * |param fft[FFT backend] The FFT implementation of the symbol detector.
+ * Automatic selects the built-in radix-4 backend.
+ * The plans are shared by every demodulator with the same symbol size.
+ * FFTW is opt-in: it measures the plan of each size once per machine
+ * and saves it as LoRaFFTW.wisdom in the user configuration directory.
+ * |option [Automatic] "auto"
+ * |option [FFTW] "fftw"
+ * |option [Built-in radix-4] "radix4"
+ * |option [Kiss FFT] "kissfft"
+ * |default "auto"
+ * |preview valid
+ *
+ * |param debugPorts[Debug ports] Enable the output of the raw, dec and fft debug ports.
+ * The demodulator does not track which ports are connected: disable the debug ports
+ * when none of them is used to skip the copies, labels and buffer waits they cost.
+ * |option [On] true
+ * |option [Off] false
+ * |default true
+ * |preview valid
+ *
+ * |param capturePath[Capture path] The path prefix of the triggered recordings.
+ * An empty path disables the capture.
+ * |default ""
+ * |widget FileEntry(mode=save)
+ * |preview valid
+ *
+ * |param captureTime[Capture time] The length of each triggered recording.
+ * |units seconds
+ * |default 1.0
+ * |preview valid
+ *
+ * |param captureRate[Capture rate] The input sample rate, which sizes the capture
+ * ring buffer and is written to the SigMF metadata.
+ * |units samples/sec
+ * |default 1e6
+ * |preview valid
+ *
+ * |param captureTrigger[Capture trigger] Capture on every sync word or only on triggers from calls and slots.
+ * |option [Sync and slots] "sync"
+ * |option [Slots only] "slots"
+ * |default "sync"
+ * |preview valid
+ *
  * |factory /lora/lora_demod(sf)
+ * |initializer setSpreadFactors(sfs)
+ * |initializer setOvs(ovs)
+ * |initializer setPacketContexts(contexts)
+ * |initializer setFFTBackend(fft)
+ * |setter setSpreadFactor(sf)
  * |setter setSync(sync)
  * |setter setThreshold(thresh)
  * |setter setMTU(mtu)
+ * |setter setEnergyGate(gate)
+ * |setter setSearchHop(searchHop)
+ * |setter setSoftOutput(soft)
+ * |setter setDebugPorts(debugPorts)
+ * |setter setCapturePath(capturePath)
+ * |setter setCaptureTime(captureTime)
+ * |setter setCaptureRate(captureRate)
+ * |setter setCaptureTrigger(captureTrigger)
  **********************************************************************/
+template <typename InType>
 class LoRaDemod : public Pothos::Block
 {
 public:
     LoRaDemod(const size_t sf):
         N(1 << sf),
-        _fineSteps(128),
-        _detector(N),
+        _sf(sf),
+        _ovs(1),
+        _contexts(1),
         _sync(0x12),
         _thresh(-30.0),
-        _mtu(256)
+        _mtu(256),
+        _gate(1.0f),
+        _searchHop(1),
+        _soft(0),
+        _fft("auto"),
+        _debugPorts(true),
+        _captureTime(1.0),
+        _captureRate(1e6),
+        _captureOnSync(true)
     {
+        loraTicksPerSecond();
+        for (size_t sf = 7; sf <= 12; sf++) _dechirp[sf] = getDechirpKernel<InType>(size_t(1) << sf);
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setSpreadFactor));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setSpreadFactors));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setOvs));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setPacketContexts));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setFFTBackend));
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setSync));
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setThreshold));
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setMTU));
-        this->setupInput(0, typeid(std::complex<float>));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setEnergyGate));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setSearchHop));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setSoftOutput));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setDebugPorts));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setCapturePath));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setCaptureTime));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setCaptureRate));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setCaptureTrigger));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, triggerCapture));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, captureDrop));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, getStats));
+        this->setupInput(0, typeid(std::complex<InType>));
         this->setupOutput(0);
-        this->setupOutput("raw", typeid(std::complex<float>));
+        this->setupOutput("raw", typeid(std::complex<InType>));
         this->setupOutput("dec", typeid(std::complex<float>));
         this->setupOutput("fft", typeid(std::complex<float>));
         
@@ -86,39 +401,60 @@ public:
         this->registerSignal("power");
         this->registerSignal("snr");
 
-        //use at most two input symbols available
-        this->input(0)->setReserve(N*2);
-
         //store port pointers to avoid lookup by name
         _rawPort = this->output("raw");
         _decPort = this->output("dec");
         _fftPort = this->output("fft");
-        
-        //generate chirp table
-        float phase = -M_PI;
-        double phaseAccum = 0.0;
-        for (size_t i = 0; i < N; i++)
-        {
-            phaseAccum += phase;
-            auto entry = std::polar(1.0, phaseAccum);
-            _upChirpTable.push_back(std::complex<float>(std::conj(entry)));
-            _downChirpTable.push_back(std::complex<float>(entry));
-            phase += (2*M_PI)/N;
-        }
-        phaseAccum = 0.0;
-        phase = 2.0 * M_PI / (N * _fineSteps);
-        for (size_t i = 0; i < N * _fineSteps; i++){
-            phaseAccum += phase;
-            auto entry = std::polar(1.0, phaseAccum);
-            _fineTuneTable.push_back(std::complex<float>(entry));
+
+        //demodulate the primary spread factor only
+        this->setSpreadFactors(std::vector<size_t>());
+    }
+
+    void setSpreadFactor(const size_t sf)
+    {
+        if (sf < 7 or sf > 12) throw Pothos::InvalidArgumentException(
+            "LoRaDemod::setSpreadFactor("+std::to_string(sf)+")", "spread factor out of range");
+        _sf = sf;
+        N = 1 << sf;
+        this->initTrackers();
+    }
+
+    void setSpreadFactors(const std::vector<size_t> &sfs)
+    {
+        for (const auto sf : sfs)
+        {
+            if (sf < 7 or sf > 12) throw Pothos::InvalidArgumentException(
+                "LoRaDemod::setSpreadFactors("+std::to_string(sf)+")", "spread factor out of range");
         }
-        
-        _fineTuneIndex = 0;
+        _sfs = sfs;
+        this->initTrackers();
+    }
+
+    void setOvs(const size_t ovs)
+    {
+        if (ovs < 1 or ovs > 256) throw Pothos::InvalidArgumentException(
+            "LoRaDemod::setOvs("+std::to_string(ovs)+")", "invalid oversampling ratio");
+        _ovs = ovs;
+        this->initTrackers();
+    }
+
+    void setPacketContexts(const size_t contexts)
+    {
+        if (contexts < 1) throw Pothos::InvalidArgumentException(
+            "LoRaDemod::setPacketContexts("+std::to_string(contexts)+")", "need at least one context");
+        _contexts = contexts;
+        this->initTrackers();
     }
 
-    static Block *make(const size_t sf)
+    void setFFTBackend(const std::string &fft)
     {
-        return new LoRaDemod(sf);
+        const auto backends = getFFTBackends();
+        if (fft != "auto" and std::find(backends.begin(), backends.end(), fft) == backends.end())
+        {
+            throw Pothos::InvalidArgumentException("LoRaDemod::setFFTBackend("+fft+")", "FFT backend not available");
+        }
+        _fft = fft;
+        this->initTrackers();
     }
 
     void setSync(const unsigned char sync)
@@ -136,261 +472,1047 @@ public:
         _mtu = mtu;
     }
 
+    void setEnergyGate(const double gate_dB)
+    {
+        if (gate_dB < 0.0) throw Pothos::InvalidArgumentException(
+            "LoRaDemod::setEnergyGate("+std::to_string(gate_dB)+")", "gate level must be non-negative");
+        _gate = std::pow(10.0, gate_dB/10);
+    }
+
+    void setSearchHop(const size_t divisor)
+    {
+        if (divisor != 1 and divisor != 2 and divisor != 4) throw Pothos::InvalidArgumentException(
+            "LoRaDemod::setSearchHop("+std::to_string(divisor)+")", "search hop must be 1, 2, or 4");
+        _searchHop = divisor;
+    }
+
+    void setSoftOutput(const size_t soft)
+    {
+        if (soft > 16) throw Pothos::InvalidArgumentException(
+            "LoRaDemod::setSoftOutput("+std::to_string(soft)+")", "at most 16 soft candidates");
+        _soft = soft;
+    }
+
+    void setDebugPorts(const bool enable)
+    {
+        _debugPorts = enable;
+    }
+
+    void setCapturePath(const std::string &path)
+    {
+        _capturePath = path;
+    }
+
+    void setCaptureTime(const double seconds)
+    {
+        if (seconds <= 0.0) throw Pothos::InvalidArgumentException(
+            "LoRaDemod::setCaptureTime("+std::to_string(seconds)+")", "capture time must be positive");
+        _captureTime = seconds;
+    }
+
+    void setCaptureRate(const double rate)
+    {
+        if (rate <= 0.0) throw Pothos::InvalidArgumentException(
+            "LoRaDemod::setCaptureRate("+std::to_string(rate)+")", "sample rate must be positive");
+        _captureRate = rate;
+    }
+
+    void setCaptureTrigger(const std::string &trigger)
+    {
+        if (trigger != "sync" and trigger != "slots") throw Pothos::InvalidArgumentException(
+            "LoRaDemod::setCaptureTrigger("+trigger+")", "unknown capture trigger");
+        _captureOnSync = (trigger == "sync");
+    }
+
+    //! Capture the window around the input consumed so far
+    void triggerCapture(void)
+    {
+        if (_capture) _capture->trigger(_capture->total(), "call");
+    }
+
+    //! Slot for the dropped signal of the decoder: the packet has just been demodulated
+    void captureDrop(const unsigned long long)
+    {
+        if (_capture) _capture->trigger(_capture->total(), "drop");
+    }
+
+    std::string getStats(void) const
+    {
+        json stats;
+        stats["samplesConsumed"] = _stats.samples;
+        stats["symbols"] = _stats.symbols;
+        stats["packets"] = _stats.packets;
+        stats["packetEnds"]["squelch"] = _stats.squelchEnds;
+        stats["packetEnds"]["mtu"] = _stats.mtuEnds;
+        stats["transforms"] = _stats.transforms;
+        stats["gatedHops"] = _stats.gatedHops;
+        stats["preambles"] = _stats.preambles;
+        stats["falseAlarms"] = _stats.falseAlarms;
+        stats["chunkAllocs"] = _stats.chunkAllocs;
+        const auto dechirpTicks = _stats.dechirpTicks*LORA_TIMER_PERIOD;
+        const auto fftTicks = _stats.fftTicks*LORA_TIMER_PERIOD;
+        stats["ticks"]["dechirp"] = dechirpTicks;
+        stats["ticks"]["fft"] = fftTicks;
+        stats["ticks"]["stateMachine"] = _stats.workTicks - std::min(_stats.workTicks, dechirpTicks + fftTicks);
+        stats["ticks"]["work"] = _stats.workTicks;
+        stats["ticksPerSecond"] = loraTicksPerSecond();
+        if (_capture)
+        {
+            stats["capture"]["triggers"] = _capture->triggers;
+            stats["capture"]["merged"] = _capture->merged;
+            stats["capture"]["dropped"] = _capture->dropped;
+            stats["capture"]["written"] = _capture->written.load();
+            stats["capture"]["errors"] = _capture->errors.load();
+            stats["capture"]["overruns"] = _capture->overruns.load();
+        }
+        return stats.dump();
+    }
+
     void activate(void)
     {
-        _state = STATE_FRAMESYNC;
-        _chirpTable = _upChirpTable.data();
+        _stats = LoRaDemodStats();
+        if (not _capturePath.empty())
+        {
+            const auto length = size_t(_captureTime*_captureRate);
+            if (length < 2) throw Pothos::InvalidArgumentException("LoRaDemod::activate()", "capture time too short for the sample rate");
+            _capture.reset(new LoRaCapture(_capturePath, *findIQFileFormat(this->input(0)->dtype()), length, _captureRate));
+        }
+        for (auto &t : _trackers)
+        {
+            t._state = LoRaDemodTracker::STATE_FRAMESYNC;
+            t._chirpTable = t._tables->up.data();
+            t._offset = 0;
+            t._prevValue = 0;
+            t._noiseFloor = 0.0f;
+            t._upchirps = 0;
+            t._gatedBlocks = 0;
+
+            //only the first context of each spread factor searches
+            t._active = true;
+            for (const auto &o : _trackers)
+            {
+                if (&o == &t) break;
+                if (o.sf == t.sf) t._active = false;
+            }
+        }
+    }
+
+    void deactivate(void)
+    {
+        //finishes the queued recordings
+        _capture.reset();
     }
 
     void work(void)
     {
+        LoRaPhaseTimer timer(_stats.workTicks);
         auto inPort = this->input(0);
-        if (inPort->elements() < N*2) return;
-        
+        const size_t elements = inPort->elements();
+        auto inBuff = inPort->buffer().as<const std::complex<InType> *>();
+
+        //the primary tracker drives the debug ports:
+        //run over every complete symbol that fits in the debug buffers
+        auto &primary = _trackers.front();
+        const bool labels = _debugPorts;
+        auto rawBuff = labels?_rawPort->buffer().as<std::complex<InType> *>():nullptr;
+        auto decBuff = labels?_decPort->buffer().as<std::complex<float> *>():nullptr;
+        auto fftBuff = labels?_fftPort->buffer().as<std::complex<float> *>():nullptr;
+        size_t rawProduced = 0;
+        size_t fftProduced = 0;
+        size_t decProduced = 0;
+        while (primary._offset + primary.NN*2 <= elements and (not labels or (
+            rawProduced + primary.NN*2 <= _rawPort->elements() and
+            decProduced + primary.N*2 <= _decPort->elements() and
+            fftProduced + primary.N <= _fftPort->elements())))
+        {
+            //packet contexts behind the primary tracker go first
+            if (_contexts > 1) this->workTrackers(inBuff, elements, primary._offset);
+
+            //without debug output, payload symbols are demodulated in batches
+            const size_t total = (not labels and primary._state == LoRaDemodTracker::STATE_DATASYMBOLS)?
+                this->demodBlock(primary, inBuff + primary._offset, this->batchSymbols(primary, elements)):
+                this->demodSymbol(primary, inBuff + primary._offset,
+                labels?rawBuff + rawProduced:nullptr,
+                labels?decBuff + decProduced:nullptr,
+                labels?fftBuff + fftProduced:nullptr, labels);
+
+            if (labels and not primary._id.empty())
+            {
+                _rawPort->postLabel(Pothos::Label(primary._id, Pothos::Object(), rawProduced));
+                _decPort->postLabel(Pothos::Label(primary._id, Pothos::Object(), decProduced));
+                _fftPort->postLabel(Pothos::Label(primary._id, Pothos::Object(), fftProduced));
+            }
+            rawProduced += total;
+            decProduced += total/_ovs;
+            fftProduced += primary.N;
+        }
+        if (labels)
+        {
+            _rawPort->produce(rawProduced);
+            _decPort->produce(decProduced);
+            _fftPort->produce(fftProduced);
+        }
+
+        //the other spread factors and packet contexts read from the same input buffer
+        this->workTrackers(inBuff, elements, elements);
+
+        //consume up to the slowest active tracker
+        size_t consumed = elements;
+        for (const auto &t : _trackers) if (t._active) consumed = std::min(consumed, t._offset);
+        for (auto &t : _trackers) if (t._active) t._offset -= consumed;
+        if (_capture) _capture->write(inBuff, consumed);
+        inPort->consume(consumed);
+        _stats.samples += consumed;
+    }
+
+    /*!
+     * Run the trackers after the primary one over the input buffer.
+     * With several packet contexts, the tracker furthest behind goes first,
+     * so that each context has the symbols the others decided
+     * for its overlapping windows, see claimedPeaks().
+     * \param limit only advance the trackers with an offset before this one
+     */
+    void workTrackers(const std::complex<InType> *inBuff, const size_t elements, const size_t limit)
+    {
+        while (true)
+        {
+            LoRaDemodTracker *next = nullptr;
+            for (size_t j = 1; j < _trackers.size(); j++)
+            {
+                auto &t = _trackers[j];
+                if (not t._active or t._offset + t.NN*2 > elements or t._offset >= limit) continue;
+                if (next == nullptr or (_contexts > 1 and t._offset < next->_offset)) next = &t;
+            }
+            if (next == nullptr) return;
+            auto &t = *next;
+            if (t._state == LoRaDemodTracker::STATE_DATASYMBOLS) this->demodBlock(t, inBuff + t._offset, this->batchSymbols(t, elements));
+            else this->demodSymbol(t, inBuff + t._offset, nullptr, nullptr, nullptr, false);
+        }
+    }
+
+    //! The number of payload symbols a tracker demodulates in one batch:
+    //! every complete symbol of the input, but with several packet contexts
+    //! only up to the offset of the next context of the spread factor
+    size_t batchSymbols(const LoRaDemodTracker &t, const size_t elements) const
+    {
+        size_t num = (elements - t._offset)/t.NN - 1;
+        if (_contexts == 1) return num;
+        for (const auto &o : _trackers)
+        {
+            if (&o == &t or o.sf != t.sf or not o._active or o._offset <= t._offset) continue;
+            num = std::min(num, (o._offset - t._offset + t.NN - 1)/t.NN);
+        }
+        return num;
+    }
+
+    //! Custom output buffer manager with slabs large enough for debug output
+    //! The slabs fit the largest spread factor so that setSpreadFactor() works at runtime.
+    Pothos::BufferManager::Sptr getOutputBufferManager(const std::string &name, const std::string &domain)
+    {
+        const size_t maxN = 1 << 12;
+        if (name == "raw")
+        {
+            Pothos::BufferManagerArgs args;
+            args.bufferSize = std::max(args.bufferSize,
+                              maxN*_ovs*2*sizeof(std::complex<InType>));
+            return Pothos::BufferManager::make("generic", args);
+        }else if (name == "dec"){
+            Pothos::BufferManagerArgs args;
+            args.bufferSize = std::max(args.bufferSize,
+                              maxN*2*sizeof(std::complex<float>));
+            return Pothos::BufferManager::make("generic", args);
+        }else if (name == "fft"){
+            Pothos::BufferManagerArgs args;
+            args.bufferSize = std::max(args.bufferSize,
+                              maxN*sizeof(std::complex<float>));
+            return Pothos::BufferManager::make("generic", args);
+        }
+        return Pothos::Block::getOutputBufferManager(name, domain);
+    }
+
+    //! Custom input buffer manager with slabs large enough for fft input
+    Pothos::BufferManager::Sptr getInputBufferManager(const std::string &name, const std::string &domain)
+    {
+        if (name == "0")
+        {
+            Pothos::BufferManagerArgs args;
+            args.bufferSize = std::max(args.bufferSize,
+                              _maxN*2*sizeof(std::complex<InType>));
+            return Pothos::BufferManager::make("generic", args);
+        }
+        return Pothos::Block::getInputBufferManager(name, domain);
+    }
+
+private:
+    //! Create the trackers for the primary and each additional spread factor,
+    //! the first tracker of each spread factor is the searching context
+    void initTrackers(void)
+    {
+        std::vector<size_t> sfs(1, _sf);
+        for (const auto sf : _sfs)
+        {
+            if (std::find(sfs.begin(), sfs.end(), sf) == sfs.end()) sfs.push_back(sf);
+        }
+
+        //build the new trackers before releasing the old ones,
+        //so the cached chirp tables and FFT plans they share are reused
+        std::vector<LoRaDemodTracker> trackers;
+        for (const auto sf : sfs) trackers.emplace_back(sf, _ovs, _fft);
+        for (size_t i = 1; i < _contexts; i++)
+        {
+            for (const auto sf : sfs)
+            {
+                trackers.emplace_back(sf, _ovs, _fft);
+                trackers.back()._active = false;
+            }
+        }
+        _trackers.swap(trackers);
+
+        //use at most two input symbols available of the largest spread factor
+        _maxN = 0;
+        for (const auto &t : _trackers) _maxN = std::max(_maxN, t.NN);
+        this->input(0)->setReserve(_maxN*2);
+
+        //the debug ports follow the primary spread factor
+        _rawPort->setReserve(N*_ovs*2);
+        _decPort->setReserve(N*2);
+        _fftPort->setReserve(N);
+    }
+
+    //! A context found a packet: hand the preamble search to an idle context
+    void handoffSearch(const LoRaDemodTracker &t, const size_t offset)
+    {
+        for (auto &o : _trackers)
+        {
+            if (&o == &t or o.sf != t.sf or o._active) continue;
+            o._active = true;
+            o._state = LoRaDemodTracker::STATE_FRAMESYNC;
+            o._chirpTable = o._tables->up.data();
+            o._offset = offset;
+            o._prevValue = short(o.N/2); //not a preamble symbol
+            o._gatedBlocks = 0;
+            o._finefreqError = 0;
+            o._finePhasor = 1.0f;
+            o._noiseFloor = t._noiseFloor;
+            o._upchirps = 0;
+            o._id = "";
+            return;
+        }
+    }
+
+    //! A context finished its packet: keep only the lowest context searching
+    void releaseSearch(LoRaDemodTracker &t)
+    {
+        for (auto &o : _trackers)
+        {
+            if (&o == &t or o.sf != t.sf or not o._active) continue;
+            if (o._state != LoRaDemodTracker::STATE_FRAMESYNC) continue;
+            if (&o < &t) t._active = false;
+            else o._active = false;
+            return;
+        }
+    }
+
+    /*!
+     * Add the bin where a symbol of another context appears in the window of t.
+     * A tone of value in a window starting at sample start with fine frequency error
+     * finefreqError shows up shifted by the timing and frequency differences of the windows.
+     * \param tone true for a repeated symbol which covers any window, such as a preamble
+     * \param owner the context which may still revise the symbol, or null
+     */
+    void claimSymbol(const LoRaDemodTracker &t, const unsigned long long window,
+        const size_t value, const unsigned long long start, const float finefreqError,
+        const bool tone, LoRaDemodTracker *owner, LoRaPeakClaims &claims) const
+    {
+        if (claims.num == LoRaPeakClaims::MAX_CLAIMS) return;
+        const long long lag = (long long)(window) - (long long)(start);
+        const float overlap = tone?1.0f:1.0f - float(std::abs(lag))/t.NN;
+        if (overlap <= 0.0f) return;
+        float bin = std::fmod(value + float(lag)/t.ovs - (t._finefreqError - finefreqError), float(t.N));
+        if (bin < 0.0f) bin += t.N;
+        claims.bins[claims.num] = bin;
+        claims.weights[claims.num] = overlap;
+        claims.owners[claims.num] = owner;
+        claims.num++;
+    }
+
+    /*!
+     * Collect the bins that the other contexts of the same spread factor
+     * attribute to their own packets in the current window of tracker t:
+     * the preamble of a synchronizing context, the sync word of a context
+     * which just matched it, and the symbols decided by contexts in the data state.
+     */
+    void claimedPeaks(const LoRaDemodTracker &t, LoRaPeakClaims &claims)
+    {
+        const auto NN = (long long)(t.NN);
+        const auto window = t._dataStart + t._symCount*t.NN;
+        for (auto &o : _trackers)
+        {
+            if (&o == &t or o.sf != t.sf or not o._active) continue;
+            const auto last = _stats.samples + o._offset;
+            switch (o._state)
+            {
+            case LoRaDemodTracker::STATE_FRAMESYNC:
+                //synchronized on up-chirps: the tone lasts for the whole preamble
+                if (o._upchirps != 0 and last >= o.NN)
+                {
+                    this->claimSymbol(t, window, size_t(o._prevValue), last - o.NN, o._finefreqError, true, nullptr, claims);
+                }
+                break;
+            case LoRaDemodTracker::STATE_DOWNCHIRP0:
+                this->claimSymbol(t, window, (_sync>>4)*8, last - 2*o.NN, o._finefreqError, false, nullptr, claims);
+                this->claimSymbol(t, window, (_sync & 0xf)*8, last - o.NN, o._finefreqError, false, nullptr, claims);
+                break;
+            case LoRaDemodTracker::STATE_DATASYMBOLS:
+            {
+                //the one or two symbols which overlap the window,
+                //the last one decided may still be revised
+                const long long delta = (long long)(window) - (long long)(o._dataStart);
+                const long long k0 = (delta >= 0)?delta/NN:-((NN-1-delta)/NN);
+                const auto symbols = o._outSymbols.as<const int16_t *>();
+                for (long long k = std::max(k0, 0LL); k <= k0+1 and k < (long long)(o._symCount); k++)
+                {
+                    const bool revisable = (size_t(k)+1 == o._symCount);
+                    this->claimSymbol(t, window, size_t(symbols[k]), o._dataStart + k*o.NN,
+                        o._finefreqError, false, revisable?&o:nullptr, claims);
+                }
+            } break;
+            default: break;
+            }
+        }
+    }
+
+    /*!
+     * Pick the peak of the last FFT which belongs to the packet of tracker t.
+     * Overlapping packets of the same spread factor each produce a peak.
+     * A peak costs its distance to the tracked packet power,
+     * its distance to a whole bin since t is tuned to its own packet,
+     * and the bins that the other contexts claim for their own packets,
+     * projected with the timing and frequency offsets of both contexts.
+     * The context which decided first only saw the start of the symbol of t:
+     * when its claim costs t more than its own second choice costs it,
+     * its last symbol is revised to that second choice instead.
+     */
+    size_t assignPeak(LoRaDemodTracker &t, const size_t value, float &power)
+    {
+        const size_t K = 8;
+        size_t indexes[K];
+        float powers[K];
+        const size_t num = t._detector.peaks(K, indexes, powers);
+        t._runnerUp = value;
+        t._margin = 0.0f;
+        if (num == 0) return value;
+
+        LoRaPeakClaims claims;
+        this->claimedPeaks(t, claims);
+
+        //the cost of each peak, without and with the claims
+        bool peak[K];
+        float costs[K];
+        float claimed[K];
+        size_t best = num;
+        size_t free = num;
+        for (size_t i = 0; i < num; i++)
+        {
+            float fIndex = 0.0f;
+            peak[i] = t._detector.fraction(indexes[i], fIndex);
+            if (not peak[i]) continue;
+            costs[i] = std::abs(powers[i] - t._trackedPower) + FRACTION_COST*std::abs(fIndex);
+            claimed[i] = costs[i];
+            for (size_t c = 0; c < claims.num; c++)
+            {
+                float distance = std::abs(indexes[i] + fIndex - claims.bins[c]);
+                distance = std::min(distance, t.N - distance);
+                if (distance < 1.0f) claimed[i] += CLAIM_COST*claims.weights[c]*(1.0f - distance);
+            }
+            if (free == num or costs[i] < costs[free]) free = i;
+            if (best == num or claimed[i] < claimed[best]) best = i;
+        }
+        if (best == num) return value;
+
+        //a revisable claim moved t off its cheapest peak: the cheaper side yields
+        for (size_t c = 0; c < claims.num and free != best; c++)
+        {
+            auto owner = claims.owners[c];
+            float distance = std::abs(float(indexes[free]) - claims.bins[c]);
+            distance = std::min(distance, t.N - distance);
+            if (owner == nullptr or distance >= 1.0f) continue;
+            if (costs[best] - costs[free] <= owner->_margin) continue;
+            owner->_outSymbols.as<int16_t *>()[owner->_symCount-1] = int16_t(owner->_runnerUp);
+            owner->_margin = 0.0f;
+            best = free;
+        }
+
+        //the second choice of t and how much more it costs
+        size_t second = num;
+        for (size_t i = 0; i < num; i++)
+        {
+            if (i == best or not peak[i]) continue;
+            if (second == num or claimed[i] < claimed[second]) second = i;
+        }
+        if (second != num)
+        {
+            t._runnerUp = indexes[second];
+            t._margin = claimed[second] - claimed[best];
+        }
+
+        power = powers[best];
+        return indexes[best];
+    }
+
+    //! Record the strongest bins of the current symbol for the soft output
+    void softSymbol(LoRaDemodTracker &t, const float powerAvg) const
+    {
+        size_t indexes[16];
+        float powers[16];
+        const size_t num = t._detector.peaks(t._softCount, indexes, powers);
+        auto out = t._outSoft.as<int16_t *>() + t._symCount*t._softCount*2;
+        for (size_t i = 0; i < num; i++)
+        {
+            const float level = std::round((powers[i] - powerAvg)*100);
+            out[2*i+0] = int16_t(indexes[i]);
+            out[2*i+1] = int16_t(std::max(-32768.0f, std::min(32767.0f, level)));
+        }
+    }
+
+    //! Annotate the capture at an offset into the current input buffer
+    void captureLabel(const size_t offset, const char *label)
+    {
+        if (_capture) _capture->annotate(_stats.samples + offset, label);
+    }
+
+    //! Dechirp one symbol of NN input samples into N points for the FFT
+    void dechirp(const LoRaDemodTracker &t, const std::complex<InType> *in,
+        std::complex<float> &phasor, const std::complex<float> &rotation, std::complex<float> *out)
+    {
+        if (t.ovs == 1) _dechirp[t.sf](in, t._chirpTable, phasor, rotation, out, t.N);
+        else dechirpDecimate(in, t._chirpTable, phasor, rotation, out, t.N, t.ovs);
+    }
+
+    /*!
+     * An int16 chunk for the symbols of a packet from the pool:
+     * a pooled chunk is free again once the packet downstream is released,
+     * a new chunk is only allocated when all of them are still referenced.
+     */
+    Pothos::BufferChunk pooledChunk(const size_t elements)
+    {
+        Pothos::BufferChunk *free = nullptr;
+        for (auto &chunk : _chunkPool)
+        {
+            if (not chunk.unique()) continue;
+            if (chunk.elements() >= elements) return chunk;
+            free = &chunk;
+        }
+        _stats.chunkAllocs++;
+        Pothos::BufferChunk chunk(typeid(int16_t), elements);
+        if (free != nullptr) *free = chunk;
+        else if (_chunkPool.size() < MAX_POOLED_CHUNKS) _chunkPool.push_back(chunk);
+        return chunk;
+    }
+
+    //! Format the debug label id in place, the string keeps its capacity
+    template <typename... Args>
+    void formatId(LoRaDemodTracker &t, const char *format, Args... args)
+    {
+        char id[32];
+        std::snprintf(id, sizeof(id), format, args...);
+        t._id = id;
+    }
+
+    /*!
+     * Record one payload symbol of a tracker in the data state,
+     * and post the packet when it is complete or the signal is lost.
+     * \param [inout] value the symbol, reassigned to the tracked peak with several contexts
+     * \return true when the packet ended
+     */
+    bool dataSymbol(LoRaDemodTracker &t, size_t &value, float power, const float powerAvg, const bool squelched)
+    {
+        if (_contexts > 1) value = this->assignPeak(t, value, power);
+        t._trackedPower += (power - t._trackedPower)/8;
+        if (t._softCount != 0) this->softSymbol(t, powerAvg);
+        t._outSymbols.as<int16_t *>()[t._symCount++] = int16_t(value);
+        _stats.symbols++;
+        if (t._symCount < _mtu and not squelched) return false;
+        _stats.packets++;
+        if (squelched) _stats.squelchEnds++;
+        else _stats.mtuEnds++;
+
+        //for (size_t j = 0; j < t._symCount; j++)
+        //    std::cout << "demod[" << j << "]=" << t._outSymbols.as<const uint16_t *>()[j] << std::endl;
+        Pothos::Packet pkt;
+        pkt.payload = t._outSymbols;
+        pkt.payload.length = t._symCount*sizeof(int16_t);
+        pkt.metadata["sf"] = Pothos::Object(t.sf);
+        if (t._softCount != 0)
+        {
+            auto soft = t._outSoft;
+            soft.length = t._symCount*t._softCount*2*sizeof(int16_t);
+            pkt.metadata["soft"] = Pothos::Object(soft);
+        }
+        this->output(0)->postMessage(pkt);
+        t._outSymbols = Pothos::BufferChunk();
+        t._outSoft = Pothos::BufferChunk();
+        t._finefreqError = 0;
+        t._state = LoRaDemodTracker::STATE_FRAMESYNC;
+        this->releaseSearch(t);
+        return true;
+    }
+
+    /*!
+     * Run the state machine of a tracker over one symbol.
+     * The debug buffers are only written when non-null,
+     * and the label id is only formatted when labels is set.
+     * \return the number of input samples to advance
+     */
+    size_t demodSymbol(LoRaDemodTracker &t, const std::complex<InType> *inBuff,
+        std::complex<InType> *rawBuff, std::complex<float> *decBuff, std::complex<float> *fftBuff,
+        const bool labels)
+    {
+        const size_t N = t.N;
+        const size_t NN = t.NN;
+        const size_t ovs = t.ovs;
+        const bool primary = (&t == &_trackers.front());
+        const size_t hop = NN/_searchHop;
+        const size_t carriedBlocks = t._gatedBlocks;
+        t._gatedBlocks = 0;
+
         size_t total = 0;
-        auto inBuff = inPort->buffer().as<const std::complex<float> *>();
-        auto rawBuff = _rawPort->buffer().as<std::complex<float> *>();
-        auto decBuff = _decPort->buffer().as<std::complex<float> *>();
-        auto fftBuff = _fftPort->buffer().as<std::complex<float> *>();
 
-        //process the available symbol
-        for (size_t i = 0; i < N; i++){
-            auto samp = inBuff[i];
-            auto decd = samp*_chirpTable[i] * _fineTuneTable[_fineTuneIndex];
-            _fineTuneIndex -= _finefreqError * _fineSteps;
-            if (_fineTuneIndex < 0) _fineTuneIndex += N * _fineSteps;
-            else if (_fineTuneIndex >= int(N * _fineSteps)) _fineTuneIndex -= N * _fineSteps;
-            rawBuff[i] = samp;
-            decBuff[i] = decd;
-            _detector.feed(i, decd);
+        //energy pre-detector: outside of a preamble, skip the FFT for
+        //symbols that do not rise above the running noise floor estimate
+        if (_gate > 1.0f and t._state == LoRaDemodTracker::STATE_FRAMESYNC and (t._prevValue+4)/8 != 0)
+        {
+            //the energy is summed over hop sized blocks: after a gated hop,
+            //only the newest block of the window needs to be measured
+            size_t b = 0;
+            if (carriedBlocks == _searchHop)
+            {
+                for (; b+1 < _searchHop; b++) t._blockEnergy[b] = t._blockEnergy[b+1];
+            }
+            for (; b < _searchHop; b++)
+            {
+                float blockEnergy = 0;
+                for (size_t i = b*hop; i < (b+1)*hop; i++) blockEnergy += std::norm(dechirpLoad(inBuff[i]));
+                t._blockEnergy[b] = blockEnergy;
+            }
+            float energy = 0;
+            for (b = 0; b < _searchHop; b++) energy += t._blockEnergy[b];
+            energy /= NN;
+
+            //the floor follows gated symbols, and only drifts slowly upwards
+            //while symbols pass the gate so a packet does not raise the floor
+            if (t._noiseFloor == 0.0f) t._noiseFloor = energy;
+            else if (energy >= t._noiseFloor*_gate) t._noiseFloor += (energy - t._noiseFloor)/256;
+            else
+            {
+                t._noiseFloor += (energy - t._noiseFloor)/16;
+                if (rawBuff != nullptr) std::memcpy(rawBuff, inBuff, NN*sizeof(std::complex<InType>));
+                if (decBuff != nullptr) std::fill(decBuff, decBuff + N, std::complex<float>());
+                if (fftBuff != nullptr) std::fill(fftBuff, fftBuff + N, std::complex<float>());
+                t._finefreqError = 0;
+                t._finePhasor = 1.0f;
+                t._id = "";
+                t._offset += hop;
+                t._prevValue = short(N/2); //not a preamble symbol
+                t._upchirps = 0;
+                t._gatedBlocks = _searchHop;
+                _stats.gatedHops++;
+                return hop;
+            }
         }
+
+        //process the available symbol
+        const auto fineRotation = t.fineTuneRotation();
+        auto fftInput = t._detector.fftInput();
+        const bool timed = loraTimerSample(_stats.timerCalls);
+        const auto ticks0 = timed?loraTicks():0;
+        this->dechirp(t, inBuff, t._finePhasor, fineRotation, fftInput);
+        if (rawBuff != nullptr) std::memcpy(rawBuff, inBuff, NN*sizeof(std::complex<InType>));
+        if (decBuff != nullptr) std::memcpy(decBuff, fftInput, N*sizeof(std::complex<float>));
         float power = 0;
         float powerAvg = 0;
         float snr = 0;
         float fIndex = 0;
         
-        auto value = _detector.detect(power,powerAvg,fIndex,fftBuff);
+        const auto ticks1 = timed?loraTicks():0;
+        auto value = t._detector.detect(power,powerAvg,fIndex,fftBuff);
+        if (timed)
+        {
+            _stats.dechirpTicks += ticks1 - ticks0;
+            _stats.fftTicks += loraTicks() - ticks1;
+        }
+        _stats.transforms++;
         snr = power - powerAvg;
         const bool squelched = (snr < _thresh);
 
-        switch (_state)
+        switch (t._state)
         {
         ////////////////////////////////////////////////////////////////
-        case STATE_FRAMESYNC:
+        case LoRaDemodTracker::STATE_FRAMESYNC:
         ////////////////////////////////////////////////////////////////
         {
             //format as observed from inspecting RN2483
-            bool syncd = not squelched and (_prevValue+4)/8 == 0;
+            bool syncd = not squelched and (t._prevValue+4)/8 == 0;
             bool match0 = (value+4)/8 == unsigned(_sync>>4);
             bool match1 = false;
+            t._upchirps = (syncd and (value+4)/8 == 0)?t._upchirps+1:0;
 
             //if the symbol matches sync word0 then check sync word1 as well
             //otherwise assume its the frame sync and adjust for frequency error
             if (syncd and match0)
             {
-                int ft = _fineTuneIndex;
-                for (size_t i = 0; i < N; i++)
-                {
-                    auto samp = inBuff[i + N];
-                    auto decd = samp*_chirpTable[i] * _fineTuneTable[ft];
-                    ft -= _finefreqError * _fineSteps;
-                    if (ft < 0) ft += N * _fineSteps;
-                    else if (ft >= int(N * _fineSteps)) ft -= N * _fineSteps;
-                    rawBuff[i+N] = samp;
-                    decBuff[i+N] = decd;
-                    _detector.feed(i, decd);
-                }
-                auto value1 = _detector.detect(power,powerAvg,fIndex);
+                auto phasor = t._finePhasor;
+                this->dechirp(t, inBuff + NN, phasor, fineRotation, fftInput);
+                if (rawBuff != nullptr) std::memcpy(rawBuff + NN, inBuff + NN, NN*sizeof(std::complex<InType>));
+                if (decBuff != nullptr) std::memcpy(decBuff + N, fftInput, N*sizeof(std::complex<float>));
+                auto value1 = t._detector.detect(power,powerAvg,fIndex);
+                _stats.transforms++;
                 //format as observed from inspecting RN2483
                 match1 = (value1+4)/8 == unsigned(_sync & 0xf);
             }
 
             if (syncd and match0 and match1)
             {
-                total = 2*N;
-                _state = STATE_DOWNCHIRP0;
-                _chirpTable = _downChirpTable.data();
-                _id = "SYNC";
+                total = 2*NN;
+                t._state = LoRaDemodTracker::STATE_DOWNCHIRP0;
+                t._chirpTable = t._tables->down.data();
+                t._id = "SYNC";
+                this->handoffSearch(t, t._offset + total);
+                _stats.preambles++;
+                this->captureLabel(t._offset, "SYNC");
+                if (_capture and _captureOnSync) _capture->trigger(_stats.samples + t._offset, "sync");
             }
 
             //otherwise its a frequency error
             else if (not squelched)
             {
-                total = N - value;
-                _finefreqError += fIndex;
-				std::stringstream stream;
-				stream.precision(4);
-				stream << std::fixed << "P " << fIndex;
-				_id = stream.str();
- //               _id = "P " + std::to_string(fIndex);
+                if (syncd and match0) _stats.falseAlarms++;
+                total = (N - value)*ovs;
+                t._finefreqError += fIndex;
+                if (labels) this->formatId(t, "P %.4f", fIndex);
             }
 
             //just noise
             else
             {
-                total = N;
-                _finefreqError = 0;
-                _fineTuneIndex = 0;
-                _id = "";
+                total = hop;
+                t._finefreqError = 0;
+                t._finePhasor = 1.0f;
+                t._id = "";
             }
 
         } break;
 
         ////////////////////////////////////////////////////////////////
-        case STATE_DOWNCHIRP0:
+        case LoRaDemodTracker::STATE_DOWNCHIRP0:
         ////////////////////////////////////////////////////////////////
         {
-            _state = STATE_DOWNCHIRP1;
-            total = N;
-            _id = "DC";
+            t._state = LoRaDemodTracker::STATE_DOWNCHIRP1;
+            total = NN;
+            t._id = "DC";
+            this->captureLabel(t._offset, "DC");
             int error = value;
             if (value > N/2) error -= N;
             //std::cout << "error0 " << error << std::endl;
-            _freqError = error;
+            t._freqError = error;
+            t._freqErrorFrac = error + fIndex;
         } break;
 
         ////////////////////////////////////////////////////////////////
-        case STATE_DOWNCHIRP1:
+        case LoRaDemodTracker::STATE_DOWNCHIRP1:
         ////////////////////////////////////////////////////////////////
         {
-            _state = STATE_QUARTERCHIRP;
-            total = N;
-            _chirpTable = _upChirpTable.data();
-            _id = "";
-            _outSymbols = Pothos::BufferChunk(typeid(int16_t), _mtu);
+            t._state = LoRaDemodTracker::STATE_QUARTERCHIRP;
+            total = NN;
+            t._chirpTable = t._tables->up.data();
+            t._id = "";
+            t._outSymbols = this->pooledChunk(_mtu);
+            t._softCount = _soft;
+            if (_soft != 0) t._outSoft = this->pooledChunk(_mtu*_soft*2);
 
             int error = value;
             if (value > N/2) error -= N;
             //std::cout << "error1 " << error << std::endl;
-            _freqError = (_freqError + error)/2;
+            t._freqError = (t._freqError + error)/2;
+            t._trackedPower = power;
+            t._freqErrorFrac = (t._freqErrorFrac + error + fIndex)/2;
 
-            this->emitSignal("error", _freqError);
-            this->emitSignal("power", power);
-            this->emitSignal("snr", snr);
+            if (primary)
+            {
+                this->emitSignal("error", t._freqError);
+                this->emitSignal("power", power);
+                this->emitSignal("snr", snr);
+            }
         } break;
 
         ////////////////////////////////////////////////////////////////
-        case STATE_QUARTERCHIRP:
+        case LoRaDemodTracker::STATE_QUARTERCHIRP:
         ////////////////////////////////////////////////////////////////
         {
-            _state = STATE_DATASYMBOLS;
-            
-            total = N/4 + (_freqError / 2);
-            _finefreqError += (_freqError / 2);
+            t._state = LoRaDemodTracker::STATE_DATASYMBOLS;
             
-            _symCount = 0;
-            _id = "QC";
+            total = (N/4 + (t._freqError / 2))*ovs;
+            t._finefreqError += (t._freqError / 2);
+
+            //sub-chip timing alignment is only resolvable when oversampled:
+            //shift the fractional timing and frequency error together
+            //so that the up-chirp alignment found during frame sync is kept,
+            //and center the chip average on the chip to undo its group delay,
+            //the step stays within the two symbols available to this call
+            if (ovs > 1)
+            {
+                const long shift = std::lround((t._freqErrorFrac/2 - (t._freqError / 2))*ovs + (ovs-1)/2.0);
+                const long shifted = std::min(std::max(long(total) + shift, 0L), long(2*NN));
+                t._finefreqError += float(shifted - long(total))/ovs;
+                total = size_t(shifted);
+            }
+
+            t._symCount = 0;
+            t._dataStart = _stats.samples + t._offset + total;
+            t._id = "QC";
+            this->captureLabel(t._offset, "QC");
         } break;
 
         ////////////////////////////////////////////////////////////////
-        case STATE_DATASYMBOLS:
+        case LoRaDemodTracker::STATE_DATASYMBOLS:
         ////////////////////////////////////////////////////////////////
         {
-            total = N;
-            _outSymbols.as<int16_t *>()[_symCount++] = int16_t(value);
-            if (_symCount >= _mtu or squelched)
-            {
-                //for (size_t j = 0; j < _symCount; j++)
-                //    std::cout << "demod[" << j << "]=" << _outSymbols.as<const uint16_t *>()[j] << std::endl;
-                Pothos::Packet pkt;
-                pkt.payload = _outSymbols;
-                pkt.payload.length = _symCount*sizeof(int16_t);
-                this->output(0)->postMessage(pkt);
-                _finefreqError = 0;
-                _state = STATE_FRAMESYNC;
-            }
-			std::stringstream stream;
-			stream.precision(4);
-			stream << std::fixed << "S" << _symCount << " " << fIndex;
-			_id = stream.str();
-            //_id = "S" + std::to_string(_symCount) + " " + std::to_string(fIndex);
+            total = NN;
+            if (this->dataSymbol(t, value, power, powerAvg, squelched)) this->captureLabel(t._offset, "END");
+            if (labels) this->formatId(t, "S%zu %.4f", t._symCount, fIndex);
             
-           // _finefreqError += fIndex;
+           // t._finefreqError += fIndex;
             
         } break;
 
         }
 
-        if (not _id.empty())
-        {
-            _rawPort->postLabel(Pothos::Label(_id, Pothos::Object(), 0));
-            _decPort->postLabel(Pothos::Label(_id, Pothos::Object(), 0));
-            _fftPort->postLabel(Pothos::Label(_id, Pothos::Object(), 0));
-        }
-        inPort->consume(total);
-        _rawPort->produce(total);
-        _decPort->produce(total);
-        
-        _fftPort->produce(N);
-        
-        _prevValue = value;
+        t._offset += total;
+        t._prevValue = value;
+        return total;
     }
 
-    //! Custom output buffer manager with slabs large enough for debug output
-    Pothos::BufferManager::Sptr getOutputBufferManager(const std::string &name, const std::string &domain)
+    /*!
+     * Run a tracker in the data state over several payload symbols at once:
+     * dechirp up to a batch of consecutive symbols, transform them in one
+     * FFT backend call, then record them in order like demodSymbol().
+     * The fine tune phasor of each symbol is kept so that a packet
+     * which ends inside the batch leaves the tracker exactly as demodSymbol() would.
+     * \param maxSymbols the number of complete symbols available in the input
+     * \return the number of input samples to advance
+     */
+    size_t demodBlock(LoRaDemodTracker &t, const std::complex<InType> *inBuff, const size_t maxSymbols)
     {
-        if (name == "raw" or name == "dec")
+        const size_t K = std::min(std::min(maxSymbols, t._detector.batchSize()), _mtu - t._symCount);
+        const auto fineRotation = t.fineTuneRotation();
+        std::complex<float> phasors[LoRaDemodTracker::MAX_BATCH];
+        const bool timed = loraTimerSample(_stats.timerCalls);
+        const auto ticks0 = timed?loraTicks():0;
+        for (size_t k = 0; k < K; k++)
         {
-            this->output(name)->setReserve(N * 2);
-            Pothos::BufferManagerArgs args;
-            args.bufferSize = N*2*sizeof(std::complex<float>);
-            return Pothos::BufferManager::make("generic", args);
-        }else if (name == "fft"){
-            this->output(name)->setReserve(N);
-            Pothos::BufferManagerArgs args;
-            args.bufferSize = N*sizeof(std::complex<float>);
-            return Pothos::BufferManager::make("generic", args);
+            this->dechirp(t, inBuff + k*t.NN, t._finePhasor, fineRotation, t._detector.fftInput(k));
+            phasors[k] = t._finePhasor;
         }
-        return Pothos::Block::getOutputBufferManager(name, domain);
-    }
+        const auto ticks1 = timed?loraTicks():0;
+        t._detector.transformBatch(K);
+        if (timed)
+        {
+            _stats.dechirpTicks += ticks1 - ticks0;
+            _stats.fftTicks += loraTicks() - ticks1;
+        }
+        _stats.transforms += K;
 
-    //! Custom input buffer manager with slabs large enough for fft input
-    Pothos::BufferManager::Sptr getInputBufferManager(const std::string &name, const std::string &domain)
-    {
-        if (name == "0")
+        size_t total = 0;
+        for (size_t k = 0; k < K; k++)
         {
-            Pothos::BufferManagerArgs args;
-            args.bufferSize = std::max(args.bufferSize,
-                              N*2*sizeof(std::complex<float>));
-            return Pothos::BufferManager::make("generic", args);
+            float power = 0;
+            float powerAvg = 0;
+            float fIndex = 0;
+            size_t value = 0;
+            {
+                LoRaPhaseTimer timer(_stats.fftTicks, timed);
+                value = t._detector.detectBatch(k, power, powerAvg, fIndex);
+            }
+            const bool squelched = (power - powerAvg < _thresh);
+            const bool done = this->dataSymbol(t, value, power, powerAvg, squelched);
+            total += t.NN;
+            t._prevValue = value;
+            if (not done) continue;
+            this->captureLabel(t._offset + total - t.NN, "END");
+            t._finePhasor = phasors[k];
+            break;
         }
-        return Pothos::Block::getInputBufferManager(name, domain);
+        t._offset += total;
+        return total;
     }
 
-private:
     //configuration
-    const size_t N;
-    const size_t _fineSteps;
-    LoRaDetector<float> _detector;
-    std::complex<float> *_chirpTable;
-    std::vector<std::complex<float>> _upChirpTable;
-    std::vector<std::complex<float>> _downChirpTable;
-    std::vector<std::complex<float>> _fineTuneTable;
+    size_t N;
+    size_t _sf;
+    size_t _ovs;
+    size_t _contexts;
+    std::vector<size_t> _sfs;
+    size_t _maxN;
+    std::vector<LoRaDemodTracker> _trackers;
     unsigned char _sync;
     float _thresh;
     size_t _mtu;
+    float _gate;
+    size_t _searchHop;
+    size_t _soft;
+    std::string _fft;
+    bool _debugPorts;
     Pothos::OutputPort *_rawPort;
     Pothos::OutputPort *_decPort;
     Pothos::OutputPort *_fftPort;
+    std::string _capturePath;
+    double _captureTime;
+    double _captureRate;
+    bool _captureOnSync;
+    DechirpKernel<InType> _dechirp[13]; //kernel per spread factor
+    LoRaDemodStats _stats;
+    static const size_t MAX_POOLED_CHUNKS = 16;
 
-    //state
-    enum LoraDemodState
-    {
-        STATE_FRAMESYNC,
-        STATE_DOWNCHIRP0,
-        STATE_DOWNCHIRP1,
-        STATE_QUARTERCHIRP,
-        STATE_DATASYMBOLS,
-    };
-    LoraDemodState _state;
-    size_t _symCount;
-    Pothos::BufferChunk _outSymbols;
-    std::string _id;
-    short _prevValue;
-    int _freqError;
-    int _fineTuneIndex;
-    float _finefreqError;
+    //! The cost in dB of a peak on a bin claimed by another context, see assignPeak()
+    static constexpr float CLAIM_COST = 12.0f;
+
+    //! The cost in dB of a peak half a bin away from a whole bin
+    static constexpr float FRACTION_COST = 6.0f;
+    std::vector<Pothos::BufferChunk> _chunkPool;
+    std::unique_ptr<LoRaCapture> _capture;
 };
 
+/***********************************************************************
+ * |PothosDoc LoRa Demod (typed)
+ *
+ * The LoRa Demod for receivers that deliver integer samples.
+ * Integer samples are converted to float in the same pass as the dechirp,
+ * so CS16 and CS8 receivers stream at their native width into the demodulator.
+ * The ports, signals, calls and parameters are those of the LoRa Demod block,
+ * which describes them in detail, the raw debug port produces the input data type.
+ *
+ * |category /LoRa
+ * |keywords lora
+ *
+ * |param dtype[Data Type] The data type of the input samples.
+ * |widget DTypeChooser(cfloat32=1,cint16=1,cint8=1)
+ * |default "complex_int16"
+ * |preview disable
+ *
+ * |param sf[Spread factor] The spreading factor controls the symbol spread.
+ * Each symbol will occupy 2^SF number of samples given the waveform BW.
+ * |default 10
+ *
+ * |param sync[Sync word] The sync word is a 2-nibble, 2-symbol sync value.
+ * |default 0x12
+ *
+ * |param thresh[Threshold] The minimum required level in dB for the detector.
+ * |units dB
+ * |default -30.0
+ *
+ * |param mtu[Symbol MTU] Produce MTU at most symbols after sync is found.
+ * |units symbols
+ * |default 256
+ *
+ * |param sfs[Spread factors] Additional spread factors to demodulate in parallel.
+ * |default []
+ * |preview valid
+ *
+ * |param ovs[Oversampling ratio] The number of input samples per chip.
+ * |default 1
+ *
+ * |param gate[Energy gate] The energy pre-detector level in dB above the noise floor.
+ * A level of 0 dB disables the pre-detector and runs the FFT for every symbol.
+ * |units dB
+ * |default 0.0
+ * |preview valid
+ *
+ * |param searchHop[Search hop] The step of the preamble search over idle input as a fraction of a symbol.
+ * |option [Full symbol] 1
+ * |option [Half symbol] 2
+ * |option [Quarter symbol] 4
+ * |default 1
+ * |preview valid
+ *
+ * |param contexts[Packet contexts] The number of packets per spread factor to track at once.
+ * |default 1
+ * |preview valid
+ *
+ * |param soft[Soft candidates] The number of candidate bins K per symbol in the soft output.
+ * |default 0
+ * |preview valid
+ *
+ * |param fft[FFT backend] The FFT implementation of the symbol detector.
+ * |option [Automatic] "auto"
+ * |option [FFTW] "fftw"
+ * |option [Built-in radix-4] "radix4"
+ * |option [Kiss FFT] "kissfft"
+ * |default "auto"
+ * |preview valid
+ *
+ * |param debugPorts[Debug ports] Enable the output of the raw, dec and fft debug ports.
+ * |option [On] true
+ * |option [Off] false
+ * |default true
+ * |preview valid
+ *
+ * |param capturePath[Capture path] The path prefix of the triggered recordings.
+ * An empty path disables the capture.
+ * |default ""
+ * |widget FileEntry(mode=save)
+ * |preview valid
+ *
+ * |param captureTime[Capture time] The length of each triggered recording.
+ * |units seconds
+ * |default 1.0
+ * |preview valid
+ *
+ * |param captureRate[Capture rate] The input sample rate for the capture ring and the SigMF metadata.
+ * |units samples/sec
+ * |default 1e6
+ * |preview valid
+ *
+ * |param captureTrigger[Capture trigger] Capture on every sync word or only on triggers from calls and slots.
+ * |option [Sync and slots] "sync"
+ * |option [Slots only] "slots"
+ * |default "sync"
+ * |preview valid
+ *
+ * |factory /lora/lora_demod_typed(sf, dtype)
+ * |initializer setSpreadFactors(sfs)
+ * |initializer setOvs(ovs)
+ * |initializer setPacketContexts(contexts)
+ * |initializer setFFTBackend(fft)
+ * |setter setSpreadFactor(sf)
+ * |setter setSync(sync)
+ * |setter setThreshold(thresh)
+ * |setter setMTU(mtu)
+ * |setter setEnergyGate(gate)
+ * |setter setSearchHop(searchHop)
+ * |setter setSoftOutput(soft)
+ * |setter setDebugPorts(debugPorts)
+ * |setter setCapturePath(capturePath)
+ * |setter setCaptureTime(captureTime)
+ * |setter setCaptureRate(captureRate)
+ * |setter setCaptureTrigger(captureTrigger)
+ **********************************************************************/
+static Pothos::Block *makeLoRaDemodTyped(const size_t sf, const Pothos::DType &dtype)
+{
+    #define ifTypeDeclareFactory(type) \
+        if (dtype == Pothos::DType(typeid(std::complex<type>))) return new LoRaDemod<type>(sf);
+    ifTypeDeclareFactory(float);
+    ifTypeDeclareFactory(int16_t);
+    ifTypeDeclareFactory(int8_t);
+    throw Pothos::InvalidArgumentException("makeLoRaDemodTyped("+dtype.toString()+")", "unsupported data type");
+}
+
+static Pothos::Block *makeLoRaDemod(const size_t sf)
+{
+    return new LoRaDemod<float>(sf);
+}
+
 static Pothos::BlockRegistry registerLoRaDemod(
-    "/lora/lora_demod", &LoRaDemod::make);
+    "/lora/lora_demod", &makeLoRaDemod);
+
+static Pothos::BlockRegistry registerLoRaDemodTyped(
+    "/lora/lora_demod_typed", &makeLoRaDemodTyped);
@@ -1,19 +1,31 @@
 // Copyright (c) 2016-2016 Lime Microsystems
 // SPDX-License-Identifier: BSL-1.0
 
-#include "kissfft.hh"
+#include "LoRaFFT.hpp"
+#include "DetectKernel.hpp"
 #include <complex>
 #include <vector>
+#include <string>
+#include <algorithm>
 
 template <typename Type>
 class LoRaDetector
 {
 public:
-    LoRaDetector(const size_t N):
+    /*!
+     * Create a detector for N point symbols using the named FFT backend.
+     * \param N the number of points per symbol
+     * \param backend the name of the FFT backend
+     * \param batch the number of symbols the batch buffers hold
+     */
+    LoRaDetector(const size_t N, const std::string &backend = "auto", const size_t batch = 1):
         N(N),
-        _fftInput(N),
-        _fftOutput(N),
-        _fft(N, false)
+        _batch(std::max<size_t>(1, batch)),
+        _fftInput(N*_batch),
+        _fftOutput(N*_batch),
+        _lastOutput(_fftOutput.data()),
+        _fft(getLoRaFFT<Type>(backend, N)),
+        _detect(getDetectKernel<Type>(N))
     {
         _powerScale = 20*std::log10(N);
         return;
@@ -22,39 +34,119 @@ public:
     //! feed simply sets an input sample
     void feed(const size_t i, const std::complex<Type> &samp)
     {
-        _fftInput[i] = samp;
+        _fftInput.data()[i] = samp;
+    }
+
+    //! direct access to the N input samples to fill in a block
+    std::complex<Type> *fftInput(void)
+    {
+        return _fftInput.data();
+    }
+
+    //! the number of symbols in a batch
+    size_t batchSize(void) const
+    {
+        return _batch;
+    }
+
+    //! direct access to the N input samples of symbol k of a batch
+    std::complex<Type> *fftInput(const size_t k)
+    {
+        return _fftInput.data() + k*N;
     }
 
     //! calculates argmax(abs(fft(input)))
     size_t detect(Type &power, Type &powerAvg, Type &fIndex, std::complex<Type> *fftOutput = nullptr)
     {
+        //the backends want aligned buffers, stage an unaligned caller buffer
         if (fftOutput == nullptr) fftOutput = _fftOutput.data();
-        _fft.transform(_fftInput.data(), fftOutput);
-        size_t maxIndex = 0;
-        Type maxValue = 0;
-        double total = 0;
+        if (FFTBuffer<Type>::aligned(fftOutput)) _fft->transform(_fftInput.data(), fftOutput);
+        else
+        {
+            _fft->transform(_fftInput.data(), _fftOutput.data());
+            std::copy(_fftOutput.data(), _fftOutput.data() + N, fftOutput);
+        }
+        return this->analyze(fftOutput, power, powerAvg, fIndex);
+    }
+
+    /*!
+     * Transform the first K symbols of the batch in one backend call.
+     * Follow with detectBatch() for each symbol in order.
+     * \param K the number of symbols, at most batchSize()
+     */
+    void transformBatch(const size_t K)
+    {
+        _fft->transformBatch(_fftInput.data(), _fftOutput.data(), K);
+    }
+
+    //! calculates argmax(abs(fft(input))) for symbol k of the last transformBatch()
+    //! peaks() then refers to this symbol like after detect()
+    size_t detectBatch(const size_t k, Type &power, Type &powerAvg, Type &fIndex)
+    {
+        return this->analyze(_fftOutput.data() + k*N, power, powerAvg, fIndex);
+    }
+
+    /*!
+     * Find the K strongest bins of the last detect() call.
+     * \param K the maximum number of peaks to find
+     * \param [out] indexes the bin indexes in order of descending power
+     * \param [out] powers the bin power in dB on the same scale as detect()
+     * \return the number of peaks found
+     */
+    size_t peaks(const size_t K, size_t *indexes, Type *powers) const
+    {
+        size_t num = 0;
         for (size_t i = 0; i < N; i++)
         {
-            auto bin = fftOutput[i];
-            auto re = bin.real();
-            auto im = bin.imag();
-            auto mag2 = re*re + im*im;
-            total += mag2;
-            if (mag2 > maxValue)
+            const auto mag2 = std::norm(_lastOutput[i]);
+            if (num == K and mag2 <= powers[K-1]) continue;
+            size_t j = (num < K)? num++ : K-1;
+            for (; j > 0 and powers[j-1] < mag2; j--)
             {
-                maxIndex = i;
-                maxValue = mag2;
+                powers[j] = powers[j-1];
+                indexes[j] = indexes[j-1];
             }
+            powers[j] = mag2;
+            indexes[j] = i;
         }
+        for (size_t j = 0; j < num; j++) powers[j] = 10*std::log10(powers[j]) - _powerScale;
+        return num;
+    }
 
-        const auto noise = std::sqrt(Type(total - maxValue));
-        const auto fundamental = std::sqrt(maxValue);
+    /*!
+     * The interpolated fractional index of a bin of the last detect() call,
+     * computed like the fIndex of the peak.
+     * \param index the bin index, such as one of peaks()
+     * \param [out] fIndex the offset of the interpolated peak from the bin
+     * \return false when a neighbor is stronger, so the bin is the skirt of another peak
+     */
+    bool fraction(const size_t index, Type &fIndex) const
+    {
+        const auto center = std::abs(_lastOutput[index]);
+        const auto left = std::abs(_lastOutput[index > 0?index-1:N-1]);
+        const auto right = std::abs(_lastOutput[index < N-1?index+1:0]);
+        if (left > center or right > center) return false;
+        const auto demon = (2.0 * center) - right - left;
+        fIndex = (demon == 0.0)? 0.0 : 0.5 * (right - left) / demon;
+        return true;
+    }
+
+private:
+    //! find the peak of a transformed symbol and its interpolated fractional index
+    size_t analyze(const std::complex<Type> *fftOutput, Type &power, Type &powerAvg, Type &fIndex)
+    {
+        _lastOutput = fftOutput;
+        Type maxValue = 0;
+        double total = 0;
+        const size_t maxIndex = _detect(fftOutput, N, maxValue, total);
 
-        powerAvg = 20*std::log10(noise) - _powerScale;
-        power = 20*std::log10(fundamental) - _powerScale;
+        //convert the squared magnitudes to dB directly, without a square root
+        const auto fundamental = std::sqrt(maxValue);
+        powerAvg = 10*std::log10(Type(total - maxValue)) - _powerScale;
+        power = 10*std::log10(maxValue) - _powerScale;
 
-        auto left = std::abs(fftOutput[maxIndex > 0?maxIndex-1:N-1]);
-        auto right = std::abs(fftOutput[maxIndex < N-1?maxIndex+1:0]);
+        auto left = std::sqrt(std::norm(fftOutput[maxIndex > 0?maxIndex-1:N-1]));
+        auto right = std::sqrt(std::norm(fftOutput[maxIndex < N-1?maxIndex+1:0]));
 
         const auto demon = (2.0 * fundamental) - right - left;
         if (demon == 0.0) fIndex = 0.0; //check for divide by 0
@@ -63,10 +155,12 @@ public:
         return maxIndex;
     }
 
-private:
     const size_t N;
+    const size_t _batch;
     Type _powerScale;
-    std::vector<std::complex<Type>> _fftInput;
-    std::vector<std::complex<Type>> _fftOutput;
-    kissfft<Type> _fft;
+    FFTBuffer<Type> _fftInput;
+    FFTBuffer<Type> _fftOutput;
+    const std::complex<Type> *_lastOutput;
+    std::shared_ptr<const LoRaFFT<Type>> _fft;
+    DetectKernel<Type> _detect;
 };
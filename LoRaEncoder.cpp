@@ -6,6 +6,10 @@
 #include <iostream>
 #include <cstring>
 #include "LoRaCodes.hpp"
+#include "LoRaStats.hpp"
+#include <json.hpp>
+
+using json = nlohmann::json;
 
 /***********************************************************************
  * |PothosDoc LoRa Encoder
@@ -25,6 +29,11 @@
  * The format of the packet payload is a buffer of unsigned shorts.
  * A 16-bit short can fit all size symbols from 7 to 12 bits.
  *
+ * <h2>Statistics</h2>
+ *
+ * The getStats() call returns a JSON object with the packets, payload bytes,
+ * and symbols encoded since activation, and the ticks spent encoding.
+ *
  * |category /LoRa
  * |keywords lora
  *
@@ -79,7 +88,11 @@ public:
 		_rdd(4),
 		_explicit(true),
 		_crc(true),
-		_whitening(true)
+		_whitening(true),
+		_packets(0),
+		_bytes(0),
+		_symbols(0),
+		_encodeTicks(0)
 	{
 		this->registerCall(this, POTHOS_FCN_TUPLE(LoRaEncoder, setSpreadFactor));
 		this->registerCall(this, POTHOS_FCN_TUPLE(LoRaEncoder, setSymbolSize));
@@ -87,6 +100,8 @@ public:
 		this->registerCall(this, POTHOS_FCN_TUPLE(LoRaEncoder, enableWhitening));
 		this->registerCall(this, POTHOS_FCN_TUPLE(LoRaEncoder, enableExplicit));
 		this->registerCall(this, POTHOS_FCN_TUPLE(LoRaEncoder, enableCrc));
+		this->registerCall(this, POTHOS_FCN_TUPLE(LoRaEncoder, getStats));
+		loraTicksPerSecond();
 		this->setupInput("0");
 		this->setupOutput("0");
 	}
@@ -129,6 +144,25 @@ public:
 		_crc = crc;
 	}
 
+	std::string getStats(void) const
+	{
+		json stats;
+		stats["packets"] = _packets;
+		stats["bytes"] = _bytes;
+		stats["symbols"] = _symbols;
+		stats["ticks"]["encode"] = _encodeTicks;
+		stats["ticksPerSecond"] = loraTicksPerSecond();
+		return stats.dump();
+	}
+
+	void activate(void)
+	{
+		_packets = 0;
+		_bytes = 0;
+		_symbols = 0;
+		_encodeTicks = 0;
+	}
+
 	void encodeFec(std::vector<uint8_t> &codewords, const size_t RDD, size_t &cOfs, size_t &dOfs, const uint8_t *bytes, const size_t count) {
 		if (RDD == 0) for (size_t i = 0; i < count; i++, dOfs++) {
 			if (dOfs & 1)
@@ -168,6 +202,7 @@ public:
 		//extract the input bytes
 		auto msg = inPort->popMessage();
 		auto pkt = msg.extract<Pothos::Packet>();
+		LoRaPhaseTimer timer(_encodeTicks);
 		size_t payloadLength = pkt.payload.length + (_crc ? 2 : 0);
 		std::vector<uint8_t> bytes(payloadLength);
 		std::memcpy(bytes.data(), pkt.payload.as<const void *>(), pkt.payload.length);
@@ -230,6 +265,9 @@ public:
 		out.payload = Pothos::BufferChunk(typeid(uint16_t), symbols.size());
 		std::memcpy(out.payload.as<void *>(), symbols.data(), out.payload.length);
 		outPort->postMessage(out);
+		_packets++;
+		_bytes += pkt.payload.length;
+		_symbols += symbols.size();
 	}
 
 private:
@@ -239,6 +277,10 @@ private:
 	bool _explicit;
 	bool _crc;
     bool _whitening;
+	unsigned long long _packets;
+	unsigned long long _bytes;
+	unsigned long long _symbols;
+	unsigned long long _encodeTicks;
 };
 
 static Pothos::BlockRegistry registerLoRaEncoder(
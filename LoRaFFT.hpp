@@ -0,0 +1,291 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <Pothos/Config.hpp>
+#include "kissfft.hh"
+#include "FFTRadix4.hpp"
+#include <complex>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <algorithm>
+
+#ifdef HAS_FFTW3F
+#include <Pothos/System.hpp>
+#include <fftw3.h>
+#endif //HAS_FFTW3F
+
+/*!
+ * Interface of a forward FFT backend for one transform size.
+ * A backend is immutable after construction and transform() is const,
+ * so one instance is shared by every detector of the same size.
+ * The input and output buffers must be aligned with FFTBuffer.
+ */
+template <typename Type>
+struct LoRaFFT
+{
+    virtual ~LoRaFFT(void){}
+
+    //! Compute the N point forward FFT of in into out, out-of-place
+    virtual void transform(const std::complex<Type> *in, std::complex<Type> *out) const = 0;
+
+    //! Compute K consecutive N point transforms, in and out hold K*N samples
+    //! Backends without a batched implementation transform one at a time.
+    virtual void transformBatch(const std::complex<Type> *in, std::complex<Type> *out, const size_t K) const
+    {
+        for (size_t j = 0; j < K; j++) this->transform(in + j*N, out + j*N);
+    }
+
+    //! The size of one transform
+    const size_t N;
+
+protected:
+    LoRaFFT(const size_t N):
+        N(N)
+    {
+        return;
+    }
+};
+
+/*!
+ * Storage for complex samples aligned for the SIMD paths of the FFT backends.
+ * Copies allocate new storage, so the aligned pointer never refers to another buffer.
+ */
+template <typename Type>
+class FFTBuffer
+{
+public:
+    static const size_t ALIGN = 64;
+
+    FFTBuffer(const size_t N):
+        _size(N),
+        _storage(N + ALIGN/sizeof(std::complex<Type>))
+    {
+        const size_t addr = size_t(_storage.data());
+        _data = reinterpret_cast<std::complex<Type> *>((addr + ALIGN - 1) & ~(ALIGN - 1));
+    }
+
+    FFTBuffer(const FFTBuffer &other):
+        FFTBuffer(other._size)
+    {
+        std::copy(other.data(), other.data() + _size, _data);
+    }
+
+    FFTBuffer &operator=(const FFTBuffer &other)
+    {
+        if (this != &other)
+        {
+            FFTBuffer copy(other);
+            std::swap(_size, copy._size);
+            std::swap(_storage, copy._storage);
+            std::swap(_data, copy._data);
+        }
+        return *this;
+    }
+
+    std::complex<Type> *data(void){return _data;}
+    const std::complex<Type> *data(void) const {return _data;}
+
+    //! Is an arbitrary buffer aligned well enough to pass to a backend?
+    static bool aligned(const void *ptr)
+    {
+        return (size_t(ptr) % ALIGN) == 0;
+    }
+
+private:
+    size_t _size;
+    std::vector<std::complex<Type>> _storage;
+    std::complex<Type> *_data;
+};
+
+//! The bundled recursive mixed radix kissfft
+template <typename Type>
+class LoRaFFTKiss : public LoRaFFT<Type>
+{
+public:
+    LoRaFFTKiss(const size_t N):
+        LoRaFFT<Type>(N),
+        _fft(N, false)
+    {
+        return;
+    }
+
+    void transform(const std::complex<Type> *in, std::complex<Type> *out) const
+    {
+        _fft.transform(in, out);
+    }
+
+private:
+    //transform does not modify the plan, only the non-const interface needs mutable
+    mutable kissfft<Type> _fft;
+};
+
+/*!
+ * The built-in radix-4 FFT for float at the LoRa sizes 2^7 to 2^12,
+ * iterative with precomputed tables and a kernel specialized for each size.
+ */
+class LoRaFFTRadix4 : public LoRaFFT<float>
+{
+public:
+    LoRaFFTRadix4(const size_t log2N):
+        LoRaFFT<float>(size_t(1) << log2N),
+        _tables(log2N),
+        _kernel(getFFTRadix4Kernel(log2N))
+    {
+        return;
+    }
+
+    //! Is a transform size supported by the radix-4 FFT?
+    static bool supported(const size_t N)
+    {
+        for (size_t log2N = FFT_RADIX4_MIN_LOG2N; log2N <= FFT_RADIX4_MAX_LOG2N; log2N++)
+        {
+            if (N == (size_t(1) << log2N)) return true;
+        }
+        return false;
+    }
+
+    void transform(const std::complex<float> *in, std::complex<float> *out) const
+    {
+        _kernel(in, out, _tables, 1);
+    }
+
+    void transformBatch(const std::complex<float> *in, std::complex<float> *out, const size_t K) const
+    {
+        _kernel(in, out, _tables, K);
+    }
+
+private:
+    const FFTRadix4Tables _tables;
+    const FFTRadix4Kernel _kernel;
+};
+
+#ifdef HAS_FFTW3F
+
+//! FFTW's planner and wisdom are not thread safe, serialize every call into them
+inline std::mutex &getFFTWMutex(void)
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+//! The wisdom file which persists the measured FFTW plans across runs
+inline std::string getFFTWWisdomPath(void)
+{
+    return Pothos::System::getUserConfigPath() + "/LoRaFFTW.wisdom";
+}
+
+/*!
+ * The FFTW backend for float: the plan comes from the wisdom on disk when it has this size,
+ * otherwise it is measured once and the wisdom is saved, so later runs skip the measurement.
+ * Only the first construction per size on a machine pays for the planning,
+ * the transforms themselves never touch the planner or the file.
+ */
+class LoRaFFTW : public LoRaFFT<float>
+{
+public:
+    LoRaFFTW(const size_t N):
+        LoRaFFT<float>(N)
+    {
+        std::lock_guard<std::mutex> lock(getFFTWMutex());
+        static bool wisdomLoaded = false;
+        if (not wisdomLoaded) fftwf_import_wisdom_from_filename(getFFTWWisdomPath().c_str());
+        wisdomLoaded = true;
+
+        auto in = fftwf_alloc_complex(N);
+        auto out = fftwf_alloc_complex(N);
+        _plan = fftwf_plan_dft_1d(int(N), in, out, FFTW_FORWARD, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+        if (_plan == nullptr)
+        {
+            _plan = fftwf_plan_dft_1d(int(N), in, out, FFTW_FORWARD, FFTW_MEASURE);
+            fftwf_export_wisdom_to_filename(getFFTWWisdomPath().c_str());
+        }
+        fftwf_free(in);
+        fftwf_free(out);
+    }
+
+    ~LoRaFFTW(void)
+    {
+        std::lock_guard<std::mutex> lock(getFFTWMutex());
+        fftwf_destroy_plan(_plan);
+    }
+
+    void transform(const std::complex<float> *in, std::complex<float> *out) const
+    {
+        //the new-array execute is thread safe, out-of-place complex plans preserve the input
+        fftwf_execute_dft(_plan,
+            reinterpret_cast<fftwf_complex *>(const_cast<std::complex<float> *>(in)),
+            reinterpret_cast<fftwf_complex *>(out));
+    }
+
+private:
+    fftwf_plan _plan;
+};
+
+#endif //HAS_FFTW3F
+
+/*!
+ * Get the names of the FFT backends compiled into this build.
+ * The first name is the backend that "auto" selects,
+ * the optional external backends come after the built-in ones.
+ */
+inline std::vector<std::string> getFFTBackends(void)
+{
+    std::vector<std::string> backends;
+    backends.push_back("radix4");
+    backends.push_back("kissfft");
+    #ifdef HAS_FFTW3F
+    backends.push_back("fftw");
+    #endif //HAS_FFTW3F
+    return backends;
+}
+
+//! Construct a new backend, FFTW and radix-4 only exist for float,
+//! and radix-4 only for the LoRa sizes, kissfft covers everything else
+template <typename Type>
+std::shared_ptr<const LoRaFFT<Type>> makeLoRaFFT(const std::string &, const size_t N)
+{
+    return std::make_shared<LoRaFFTKiss<Type>>(N);
+}
+
+template <>
+inline std::shared_ptr<const LoRaFFT<float>> makeLoRaFFT<float>(const std::string &backend, const size_t N)
+{
+    #ifdef HAS_FFTW3F
+    if (backend == "fftw") return std::make_shared<LoRaFFTW>(N);
+    #endif //HAS_FFTW3F
+    if (backend == "radix4" and LoRaFFTRadix4::supported(N))
+    {
+        size_t log2N = 0;
+        while ((size_t(1) << log2N) < N) log2N++;
+        return std::make_shared<LoRaFFTRadix4>(log2N);
+    }
+    return std::make_shared<LoRaFFTKiss<float>>(N);
+}
+
+/*!
+ * Get the shared FFT backend for a transform size.
+ * Like the chirp tables, the cache only holds weak references:
+ * a plan is built on first use and freed with its last detector.
+ * \param backend a name from getFFTBackends() or "auto" for the fastest one
+ * \param N the size of the transform
+ */
+template <typename Type>
+std::shared_ptr<const LoRaFFT<Type>> getLoRaFFT(const std::string &backend, const size_t N)
+{
+    const auto name = (backend == "auto")? getFFTBackends().front() : backend;
+    static std::mutex mutex;
+    static std::map<std::pair<std::string, size_t>, std::weak_ptr<const LoRaFFT<Type>>> cache;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &entry = cache[std::make_pair(name, N)];
+    auto fft = entry.lock();
+    if (not fft)
+    {
+        fft = makeLoRaFFT<Type>(name, N);
+        entry = fft;
+    }
+    return fft;
+}
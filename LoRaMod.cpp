@@ -2,10 +2,15 @@
 // SPDX-License-Identifier: BSL-1.0
 
 #include <Pothos/Framework.hpp>
-#include "ChirpGenerator.hpp"
+#include "ChirpTables.hpp"
+#include "LoRaStats.hpp"
+#include <json.hpp>
 #include <iostream>
 #include <complex>
 #include <cmath>
+#include <cstdio>
+
+using json = nlohmann::json;
 
 /***********************************************************************
  * |PothosDoc LoRa Mod
@@ -23,6 +28,12 @@
  * The output port 0 produces a complex sample stream of modulated chirps
  * to be transmitted at the specified bandwidth and carrier frequency.
  *
+ * <h2>Statistics</h2>
+ *
+ * The getStats() call returns a JSON object counting the packets and payload symbols
+ * modulated and the samples produced since activation, with the ticks spent in work.
+ * The work runs once per symbol, so its ticks are sampled on one call in 16 and scaled.
+ *
  * |category /LoRa
  * |keywords lora
  *
@@ -57,18 +68,26 @@ class LoRaMod : public Pothos::Block
 public:
 	LoRaMod(const size_t sf) :
 		N(1 << sf),
+		_sf(sf),
 		_ovs(1),
 		_sync(0x12),
 		_padding(1),
-		_ampl(0.3f)
+		_ampl(0.3f),
+		_packets(0),
+		_symbols(0),
+		_samples(0),
+		_workTicks(0),
+		_workCalls(0)
     {
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, setSync));
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, setPadding));
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, setAmplitude));
 		this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, setOvs));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, getStats));
         this->setupInput(0);
         this->setupOutput(0, typeid(std::complex<float>));
 		_phaseAccum = 0;
+        loraTicksPerSecond();
     }
 
     static Block *make(const size_t sf)
@@ -101,13 +120,31 @@ public:
 		}
 	}
 
+    std::string getStats(void) const
+    {
+        json stats;
+        stats["packets"] = _packets;
+        stats["symbols"] = _symbols;
+        stats["samplesProduced"] = _samples;
+        stats["ticks"]["work"] = _workTicks*LORA_TIMER_PERIOD;
+        stats["ticksPerSecond"] = loraTicksPerSecond();
+        return stats.dump();
+    }
+
     void activate(void)
     {
+        _tables = getChirpTables(_sf, _ovs);
         _state = STATE_WAITINPUT;
+        _packets = 0;
+        _symbols = 0;
+        _samples = 0;
+        _workTicks = 0;
+        _workCalls = 0;
     }
 
     void work(void)
     {
+        LoRaPhaseTimer timer(_workTicks, loraTimerSample(_workCalls));
         auto outPort = this->output(0);
         //float freq = 0.0;
         const size_t NN = N  * _ovs;
@@ -131,6 +168,7 @@ public:
             auto msg = this->input(0)->popMessage();
             auto pkt = msg.extract<Pothos::Packet>();
             _payload = pkt.payload;
+            _packets++;
             _state = STATE_FRAMESYNC;
             _counter = 10;
             _phaseAccum = 0;
@@ -142,7 +180,7 @@ public:
         ////////////////////////////////////////////////////////////////
         {
             _counter--;
-            i = genChirp(samps, N, _ovs, NN, 0.0f, false, _ampl, _phaseAccum);
+            i = _tables->genChirp(samps, 0, NN, false, _ampl, _phaseAccum);
             if (_counter == 0) _state = STATE_SYNCWORD0;
         } break;
 
@@ -151,8 +189,7 @@ public:
         ////////////////////////////////////////////////////////////////
         {
             const int sw0 = (_sync >> 4)*8;
-            const float freq = (2*M_PI*sw0)/NN;
-            i = genChirp(samps, N, _ovs, NN, freq, false, _ampl, _phaseAccum);
+            i = _tables->genChirp(samps, sw0*_ovs, NN, false, _ampl, _phaseAccum);
             _state = STATE_SYNCWORD1;
             _id = "SYNC";
         } break;
@@ -162,8 +199,7 @@ public:
         ////////////////////////////////////////////////////////////////
         {
             const int sw1 = (_sync & 0xf)*8;
-            const float freq = (2*M_PI*sw1)/NN;
-            i = genChirp(samps, N, _ovs, NN, freq, false, _ampl, _phaseAccum);
+            i = _tables->genChirp(samps, sw1*_ovs, NN, false, _ampl, _phaseAccum);
             _state = STATE_DOWNCHIRP0;
             _id = "";
         } break;
@@ -172,7 +208,7 @@ public:
         case STATE_DOWNCHIRP0:
         ////////////////////////////////////////////////////////////////
         {
-            i = genChirp(samps, N, _ovs, NN, 0.0f, true, _ampl, _phaseAccum);
+            i = _tables->genChirp(samps, 0, NN, true, _ampl, _phaseAccum);
             _state = STATE_DOWNCHIRP1;
             _id = "DC";
         } break;
@@ -181,7 +217,7 @@ public:
         case STATE_DOWNCHIRP1:
         ////////////////////////////////////////////////////////////////
         {
-            i = genChirp(samps, N, _ovs, NN, 0.0f, true, _ampl, _phaseAccum);
+            i = _tables->genChirp(samps, 0, NN, true, _ampl, _phaseAccum);
             _state = STATE_QUARTERCHIRP;
             _id = "";
         } break;
@@ -190,7 +226,7 @@ public:
         case STATE_QUARTERCHIRP:
         ////////////////////////////////////////////////////////////////
         {
-            i = genChirp(samps, N, _ovs, NN / 4, 0.0f, true, _ampl, _phaseAccum);
+            i = _tables->genChirp(samps, 0, NN / 4, true, _ampl, _phaseAccum);
             _state = STATE_DATASYMBOLS;
             _counter = 0;
             _id = "QC";
@@ -201,8 +237,8 @@ public:
         ////////////////////////////////////////////////////////////////
         {
             const int sym = _payload.as<const uint16_t *>()[_counter++];
-            const float freq = (2*M_PI*sym)/NN;
-            i = genChirp(samps, N, _ovs, NN, freq, false, _ampl, _phaseAccum);
+            i = _tables->genChirp(samps, sym*_ovs, NN, false, _ampl, _phaseAccum);
+            _symbols++;
         
             if (_counter >= _payload.elements())
             {
@@ -211,7 +247,9 @@ public:
                 _state = STATE_PADSYMBOLS;
                 _counter = 0;
             }
-            _id = "S" + std::to_string(_counter);
+            char id[16];
+            std::snprintf(id, sizeof(id), "S%zu", _counter);
+            _id = id; //keeps the capacity of the string, no allocation
         } break;
 
         ////////////////////////////////////////////////////////////////
@@ -235,6 +273,7 @@ public:
             outPort->postLabel(Pothos::Label(_id, Pothos::Object(), 0));
         }
         outPort->produce(i);
+        _samples += i;
     }
 
     //! Custom output buffer manager with slabs large enough for output chirp
@@ -253,11 +292,13 @@ public:
 private:
     //configuration
     const size_t N;
+    const size_t _sf;
 	size_t _ovs;
     unsigned char _sync;
     size_t _padding;
     float _ampl;
 	float _phaseAccum;
+    std::shared_ptr<const ChirpTables> _tables;
     //state
     enum LoraDemodState
     {
@@ -275,6 +316,12 @@ private:
     size_t _counter;
     Pothos::BufferChunk _payload;
     std::string _id;
+    //statistics
+    unsigned long long _packets;
+    unsigned long long _symbols;
+    unsigned long long _samples;
+    unsigned long long _workTicks;
+    unsigned long long _workCalls;
 };
 
 static Pothos::BlockRegistry registerLoRaMod(
@@ -0,0 +1,79 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <Pothos/Config.hpp>
+#include <chrono>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LORA_STATS_TSC
+#include <x86intrin.h>
+#endif
+
+/*!
+ * A cheap timestamp for the phase timers of the LoRa blocks:
+ * the time stamp counter on x86, elsewhere the steady clock in nanoseconds.
+ */
+static inline unsigned long long loraTicks(void)
+{
+    #ifdef LORA_STATS_TSC
+    return __rdtsc();
+    #else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    #endif //LORA_STATS_TSC
+}
+
+/*!
+ * The rate of loraTicks() to convert the phase timers into seconds.
+ * The time stamp counter is measured against the steady clock since the first call,
+ * the blocks call this on construction so that no calibration delay is needed later.
+ */
+inline double loraTicksPerSecond(void)
+{
+    #ifdef LORA_STATS_TSC
+    static const auto clock0 = std::chrono::steady_clock::now();
+    static const auto ticks0 = loraTicks();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - clock0).count();
+    if (seconds <= 0.0) return 0.0;
+    return (loraTicks() - ticks0)/seconds;
+    #else
+    return 1e9;
+    #endif //LORA_STATS_TSC
+}
+
+/*!
+ * The per-symbol phase timers only read the clock on one call in LORA_TIMER_PERIOD:
+ * reading the time stamp counter costs about as much as dechirping a SF7 symbol,
+ * the sampled totals are multiplied by the period when reported.
+ */
+static const unsigned long long LORA_TIMER_PERIOD = 16;
+
+//! Count a call and tell whether the phase timers sample it
+static inline bool loraTimerSample(unsigned long long &calls)
+{
+    return (calls++ % LORA_TIMER_PERIOD) == 0;
+}
+
+//! Add the ticks spent in the scope of the timer to a phase total, when enabled
+class LoRaPhaseTimer
+{
+public:
+    LoRaPhaseTimer(unsigned long long &total, const bool enabled = true):
+        _total(total),
+        _start(enabled?loraTicks():0),
+        _enabled(enabled)
+    {
+        return;
+    }
+
+    ~LoRaPhaseTimer(void)
+    {
+        if (_enabled) _total += loraTicks() - _start;
+    }
+
+private:
+    unsigned long long &_total;
+    const unsigned long long _start;
+    const bool _enabled;
+};
@@ -0,0 +1,56 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Testing.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Proxy.hpp>
+#include <iostream>
+#include <complex>
+#include <cmath>
+
+POTHOS_TEST_BLOCK("/lora/tests", test_channelizer)
+{
+    auto env = Pothos::ProxyEnvironment::make("managed");
+    auto registry = env->findProxy("Pothos/BlockRegistry");
+
+    const size_t M = 8;
+    auto feeder = registry.call("/blocks/feeder_source", "complex_float32");
+    auto channelizer = registry.call("/lora/channelizer", M);
+    std::vector<Pothos::Proxy> collectors;
+    for (size_t k = 0; k < M; k++)
+    {
+        collectors.push_back(registry.call("/blocks/collector_sink", "complex_float32"));
+    }
+
+    //a tone in the center of channel 3
+    const size_t numSamps = M*4096;
+    Pothos::BufferChunk tone(typeid(std::complex<float>), numSamps);
+    for (size_t n = 0; n < numSamps; n++)
+    {
+        tone.as<std::complex<float> *>()[n] = std::polar(1.0f, float(2*M_PI*((3*n) % M)/M));
+    }
+    feeder.call("feedBuffer", tone);
+
+    //create tester topology
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, channelizer, 0);
+        for (size_t k = 0; k < M; k++) topology.connect(channelizer, k, collectors[k], 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //all of the power should be in channel 3
+    for (size_t k = 0; k < M; k++)
+    {
+        auto buff = collectors[k].call<Pothos::BufferChunk>("getBuffer");
+        POTHOS_TEST_EQUAL(buff.elements(), numSamps/M);
+        double power = 0.0;
+        const auto samps = buff.as<const std::complex<float> *>();
+        for (size_t n = 100; n < buff.elements(); n++) power += std::norm(samps[n]);
+        power /= (buff.elements()-100);
+        std::cout << "channel " << k << " power " << 10*std::log10(power) << " dB" << std::endl;
+        if (k == 3) POTHOS_TEST_TRUE(power > 0.9);
+        else POTHOS_TEST_TRUE(power < 1e-6);
+    }
+}
@@ -135,6 +135,63 @@ POTHOS_TEST_BLOCK("/lora/tests", test_parity54_sx)
     }
 }
 
+POTHOS_TEST_BLOCK("/lora/tests", test_codeword_decoder_sx)
+{
+    //the batch decoders match the single codeword decoders on every codeword
+    for (size_t RDD = 0; RDD <= 4; RDD++)
+    {
+        std::cout << "Testing RDD " << RDD << std::endl;
+        std::vector<uint8_t> codewords(512);
+        for (size_t i = 0; i < codewords.size(); i++) codewords[i] = uint8_t(i);
+        std::vector<uint8_t> expected(codewords.size()/2);
+        bool expectedError = false, expectedBad = false;
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            unsigned char lo = 0, hi = 0;
+            const auto c0 = codewords[2*i], c1 = codewords[2*i+1];
+            switch (RDD)
+            {
+            case 0: lo = c0 & 0xf; hi = c1 & 0xf; break;
+            case 1: lo = checkParity54(c0, expectedError); hi = checkParity54(c1, expectedError); break;
+            case 2: lo = checkParity64(c0, expectedError); hi = checkParity64(c1, expectedError); break;
+            case 3: lo = decodeHamming74sx(c0, expectedError); hi = decodeHamming74sx(c1, expectedError); break;
+            case 4: lo = decodeHamming84sx(c0, expectedError, expectedBad); hi = decodeHamming84sx(c1, expectedError, expectedBad); break;
+            }
+            expected[i] = lo | (hi << 4);
+        }
+
+        for (const auto decoder : {CodewordDecoder(&decodeCodewordsScalar), getCodewordDecoder()})
+        {
+            //all codewords, and valid codewords only, with an odd length for the tail
+            std::vector<uint8_t> actual(expected.size());
+            bool error = false, bad = false;
+            decoder(codewords.data(), actual.data(), actual.size(), RDD, error, bad);
+            POTHOS_TEST_EQUALV(expected, actual);
+            POTHOS_TEST_EQUAL(error, expectedError);
+            POTHOS_TEST_EQUAL(bad, expectedBad);
+
+            const size_t numBytes = 37;
+            std::vector<uint8_t> valid(numBytes*2), data(numBytes);
+            for (size_t i = 0; i < valid.size(); i++)
+            {
+                const unsigned char x = std::rand() & 0xf;
+                if (RDD == 0) valid[i] = x;
+                if (RDD == 1) valid[i] = encodeParity54(x);
+                if (RDD == 2) valid[i] = encodeParity64(x);
+                if (RDD == 3) valid[i] = encodeHamming74sx(x);
+                if (RDD == 4) valid[i] = encodeHamming84sx(x);
+                data[i/2] |= x << (4*(i%2));
+            }
+            std::vector<uint8_t> decoded(numBytes);
+            error = bad = false;
+            decoder(valid.data(), decoded.data(), decoded.size(), RDD, error, bad);
+            POTHOS_TEST_EQUALV(data, decoded);
+            POTHOS_TEST_TRUE(not error);
+            POTHOS_TEST_TRUE(not bad);
+        }
+    }
+}
+
 POTHOS_TEST_BLOCK("/lora/tests", test_interleaver_sx)
 {
     for (size_t PPM = 7; PPM <= 12; PPM++)
@@ -157,3 +214,69 @@ POTHOS_TEST_BLOCK("/lora/tests", test_interleaver_sx)
         }
     }
 }
+
+POTHOS_TEST_BLOCK("/lora/tests", test_interleaver_bits_sx)
+{
+    //the word parallel interleavers match a bit by bit reference over several blocks
+    const size_t numBlocks = 3;
+    for (size_t PPM = 5; PPM <= 12; PPM++)
+    {
+        for (size_t RDD = 0; RDD <= 4; RDD++)
+        {
+            std::cout << "Testing PPM " << PPM << " with RDD " << RDD << std::endl;
+            const size_t nb = 4 + RDD;
+            std::vector<uint8_t> codewords(numBlocks*PPM);
+            for (auto &x : codewords) x = std::rand() & 0xff;
+            std::vector<uint16_t> symbols(numBlocks*nb), expectedSymbols(numBlocks*nb);
+            std::vector<uint8_t> deinterleaved(numBlocks*PPM), expectedCodewords(numBlocks*PPM);
+            for (size_t x = 0; x < numBlocks; x++)
+            {
+                for (size_t k = 0; k < nb; k++)
+                {
+                    for (size_t m = 0; m < PPM; m++)
+                    {
+                        const size_t i = (m + k) % PPM;
+                        expectedSymbols[x*nb + k] |= ((codewords[x*PPM + i] >> k) & 0x1) << m;
+                        expectedCodewords[x*PPM + i] |= ((codewords[x*PPM + i] >> k) & 0x1) << k;
+                    }
+                }
+            }
+
+            diagonalInterleaveSx(codewords.data(), codewords.size(), symbols.data(), PPM, RDD);
+            POTHOS_TEST_EQUALV(expectedSymbols, symbols);
+            diagonalDeterleaveSx(symbols.data(), symbols.size(), deinterleaved.data(), PPM, RDD);
+            POTHOS_TEST_EQUALV(expectedCodewords, deinterleaved);
+        }
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_whitening_sx)
+{
+    //the keystream tables match the sequence generator from any offset
+    for (size_t RDD = 0; RDD <= 4; RDD++)
+    {
+        std::cout << "Testing whitening with RDD " << RDD << std::endl;
+        for (const int bitOfs : {0, 1, 8, 37, 509, 510, 1234})
+        {
+            const size_t numCodewords = 1100;
+            std::vector<uint8_t> input(numCodewords), expected(numCodewords);
+            for (size_t j = 0; j < numCodewords; j++)
+            {
+                input[j] = std::rand() & ((1 << (4 + RDD)) - 1);
+                expected[j] = input[j] ^ Sx1272WhiteningKey(j + bitOfs, RDD);
+            }
+
+            auto whitened = input;
+            Sx1272ComputeWhitening(whitened.data(), whitened.size(), bitOfs, RDD);
+            POTHOS_TEST_EQUALV(expected, whitened);
+
+            whitened = input;
+            Sx1272ComputeWhiteningLfsr(whitened.data(), whitened.size(), bitOfs, RDD);
+            POTHOS_TEST_EQUALV(expected, whitened);
+
+            //dewhitening is the same operation
+            Sx1272ComputeWhiteningLfsr(whitened.data(), whitened.size(), bitOfs, RDD);
+            POTHOS_TEST_EQUALV(input, whitened);
+        }
+    }
+}
@@ -4,7 +4,11 @@
 #include <Pothos/Testing.hpp>
 #include "LoRaDetector.hpp"
 #include "ChirpGenerator.hpp"
+#include "ChirpTables.hpp"
+#include "DechirpKernel.hpp"
 #include <iostream>
+#include <cstdlib>
+#include <chrono>
 
 POTHOS_TEST_BLOCK("/lora/tests", test_detector)
 {
@@ -33,3 +37,271 @@ POTHOS_TEST_BLOCK("/lora/tests", test_detector)
         POTHOS_TEST_TRUE(power > -10.0);
     }
 }
+
+POTHOS_TEST_BLOCK("/lora/tests", test_dechirp_kernel)
+{
+    const size_t N = 1 << 12;
+    std::vector<std::complex<float>> samps(N), chirp(N);
+    for (auto &x : samps) x = std::complex<float>(std::rand(), std::rand())/float(RAND_MAX);
+    for (auto &x : chirp) x = std::polar(1.0f, float(std::rand()));
+
+    //the selected kernel must match the scalar kernel and an exact rotation
+    auto kernel = getDechirpKernel();
+    for (const double freq : {0.0, 0.3, -1.7, 25.0, -300.5})
+    {
+        std::cout << "testing dechirp kernel with freq = " << freq << std::endl;
+        const auto rotation = std::complex<float>(std::polar(1.0, -2*M_PI*freq/N));
+        std::vector<std::complex<float>> expected(N), actual(N);
+        std::complex<float> expectedPhasor(1.0f), actualPhasor(1.0f);
+        dechirpScalar(samps.data(), chirp.data(), expectedPhasor, rotation, expected.data(), N-1);
+        kernel(samps.data(), chirp.data(), actualPhasor, rotation, actual.data(), N-1);
+        POTHOS_TEST_CLOSE(std::abs(actualPhasor), 1.0f, 1e-6);
+        POTHOS_TEST_CLOSE(std::abs(expectedPhasor - actualPhasor), 0.0f, 1e-3);
+        for (size_t i = 0; i < N-1; i++)
+        {
+            const auto exact = samps[i]*chirp[i]*std::complex<float>(std::polar(1.0, -2*M_PI*freq*i/N));
+            POTHOS_TEST_CLOSE(std::abs(expected[i] - actual[i]), 0.0f, 1e-3);
+            POTHOS_TEST_CLOSE(std::abs(exact - actual[i]), 0.0f, 1e-3);
+        }
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_dechirp_kernel_int)
+{
+    const size_t N = 1 << 10;
+    std::vector<std::complex<int16_t>> samps16(N);
+    std::vector<std::complex<int8_t>> samps8(N);
+    std::vector<std::complex<float>> samps(N), chirp(N);
+    for (size_t i = 0; i < N; i++)
+    {
+        samps16[i] = std::complex<int16_t>(std::rand()%65536 - 32768, std::rand()%65536 - 32768);
+        samps8[i] = std::complex<int8_t>(samps16[i].real() >> 8, samps16[i].imag() >> 8);
+        chirp[i] = std::polar(1.0f, float(std::rand()));
+    }
+
+    //integer kernels match the float kernel on the scaled samples
+    const auto rotation = std::complex<float>(std::polar(1.0, -2*M_PI*1.3/N));
+    std::vector<std::complex<float>> expected(N), actual(N);
+    std::complex<float> expectedPhasor(1.0f), actualPhasor(1.0f);
+    for (size_t i = 0; i < N; i++) samps[i] = std::complex<float>(samps16[i].real(), samps16[i].imag())/32768.0f;
+    dechirpScalar(samps.data(), chirp.data(), expectedPhasor, rotation, expected.data(), N-1);
+    getDechirpKernel<int16_t>()(samps16.data(), chirp.data(), actualPhasor, rotation, actual.data(), N-1);
+    POTHOS_TEST_CLOSE(std::abs(expectedPhasor - actualPhasor), 0.0f, 1e-3);
+    for (size_t i = 0; i < N-1; i++) POTHOS_TEST_CLOSE(std::abs(expected[i] - actual[i]), 0.0f, 1e-3);
+
+    expectedPhasor = actualPhasor = 1.0f;
+    for (size_t i = 0; i < N; i++) samps[i] = std::complex<float>(samps8[i].real(), samps8[i].imag())/128.0f;
+    dechirpScalar(samps.data(), chirp.data(), expectedPhasor, rotation, expected.data(), N-1);
+    getDechirpKernel<int8_t>()(samps8.data(), chirp.data(), actualPhasor, rotation, actual.data(), N-1);
+    POTHOS_TEST_CLOSE(std::abs(expectedPhasor - actualPhasor), 0.0f, 1e-3);
+    for (size_t i = 0; i < N-1; i++) POTHOS_TEST_CLOSE(std::abs(expected[i] - actual[i]), 0.0f, 1e-3);
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_detect_kernel)
+{
+    const size_t N = 1 << 10;
+    std::vector<std::complex<float>> bins(N);
+    auto kernel = getDetectKernel<float>();
+    for (const size_t peak : {0, 1, 5, 333, 1020, 1023})
+    {
+        std::cout << "testing detect kernel with peak = " << peak << std::endl;
+        for (auto &x : bins) x = std::complex<float>(std::rand(), std::rand())/float(RAND_MAX);
+        bins[peak] = std::complex<float>(3.0f, -2.0f);
+        bins[(peak+7)%N] = bins[peak]; //ties resolve to the lowest index
+
+        float expectedMax, actualMax;
+        double expectedTotal, actualTotal;
+        const size_t expected = detectScalar(bins.data(), N, expectedMax, expectedTotal);
+        const size_t actual = kernel(bins.data(), N, actualMax, actualTotal);
+        POTHOS_TEST_EQUAL(expected, std::min(peak, (peak+7)%N));
+        POTHOS_TEST_EQUAL(expected, actual);
+        POTHOS_TEST_EQUAL(expectedMax, actualMax);
+        POTHOS_TEST_CLOSE(expectedTotal, actualTotal, 1e-3);
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_sized_kernels)
+{
+    //the kernels selected per spread factor match the scalar kernels
+    for (size_t sf = 7; sf <= 12; sf++)
+    {
+        std::cout << "testing sized kernels with SF = " << sf << std::endl;
+        const size_t N = size_t(1) << sf;
+        std::vector<std::complex<int16_t>> samps16(N);
+        std::vector<std::complex<float>> samps(N), chirp(N);
+        for (size_t i = 0; i < N; i++)
+        {
+            samps16[i] = std::complex<int16_t>(std::rand()%65536 - 32768, std::rand()%65536 - 32768);
+            samps[i] = std::complex<float>(samps16[i].real(), samps16[i].imag())/32768.0f;
+            chirp[i] = std::polar(1.0f, float(std::rand()));
+        }
+
+        const auto rotation = std::complex<float>(std::polar(1.0, -2*M_PI*2.7/N));
+        std::vector<std::complex<float>> expected(N), actual(N), actual16(N);
+        std::complex<float> expectedPhasor(1.0f), actualPhasor(1.0f), actualPhasor16(1.0f);
+        dechirpScalar(samps.data(), chirp.data(), expectedPhasor, rotation, expected.data(), N);
+        getDechirpKernel<float>(N)(samps.data(), chirp.data(), actualPhasor, rotation, actual.data(), N);
+        getDechirpKernel<int16_t>(N)(samps16.data(), chirp.data(), actualPhasor16, rotation, actual16.data(), N);
+        POTHOS_TEST_CLOSE(std::abs(actualPhasor), 1.0f, 1e-6);
+        POTHOS_TEST_CLOSE(std::abs(expectedPhasor - actualPhasor), 0.0f, 1e-3);
+        POTHOS_TEST_CLOSE(std::abs(expectedPhasor - actualPhasor16), 0.0f, 1e-3);
+        for (size_t i = 0; i < N; i++)
+        {
+            POTHOS_TEST_CLOSE(std::abs(expected[i] - actual[i]), 0.0f, 1e-3);
+            POTHOS_TEST_CLOSE(std::abs(expected[i] - actual16[i]), 0.0f, 1e-3);
+        }
+
+        expected[N/3] = expected[N-1] = std::complex<float>(3.0f, -2.0f);
+        float expectedMax, actualMax;
+        double expectedTotal, actualTotal;
+        POTHOS_TEST_EQUAL(detectScalar(expected.data(), N, expectedMax, expectedTotal), N/3);
+        POTHOS_TEST_EQUAL(getDetectKernel<float>(N)(expected.data(), N, actualMax, actualTotal), N/3);
+        POTHOS_TEST_EQUAL(expectedMax, actualMax);
+        POTHOS_TEST_CLOSE(expectedTotal, actualTotal, 1e-3);
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_detector_peaks)
+{
+    const size_t N = 1 << 8;
+    float phaseAccum = 0.0f;
+    std::vector<std::complex<float>> downChirp(N), strong(N), weak(N);
+    genChirp(downChirp.data(), N, 1, N, 0.0f, true, 1.0f, phaseAccum);
+    phaseAccum = 0.0f;
+    genChirp(strong.data(), N, 1, N, float(2*M_PI*100)/N, false, 1.0f, phaseAccum);
+    phaseAccum = 0.0f;
+    genChirp(weak.data(), N, 1, N, float(2*M_PI*20)/N, false, 0.5f, phaseAccum);
+
+    //two overlapping symbols: both peaks are found in order of power
+    LoRaDetector<float> detector(N);
+    for (size_t i = 0; i < N; i++) detector.feed(i, downChirp[i]*(strong[i] + weak[i]));
+    float power, powerAvg, fIndex;
+    POTHOS_TEST_EQUAL(detector.detect(power, powerAvg, fIndex), 100);
+    size_t indexes[4];
+    float powers[4];
+    POTHOS_TEST_EQUAL(detector.peaks(4, indexes, powers), 4);
+    POTHOS_TEST_EQUAL(indexes[0], 100);
+    POTHOS_TEST_EQUAL(indexes[1], 20);
+    POTHOS_TEST_CLOSE(powers[0], power, 0.01);
+    POTHOS_TEST_CLOSE(powers[0] - powers[1], 6.0, 0.1);
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_chirp_tables)
+{
+    //tables are shared while referenced and keyed by spread factor and ovs
+    auto tables = getChirpTables(9, 2);
+    POTHOS_TEST_TRUE(tables == getChirpTables(9, 2));
+    POTHOS_TEST_TRUE(tables != getChirpTables(9, 1));
+    POTHOS_TEST_TRUE(tables != getChirpTables(10, 2));
+    POTHOS_TEST_EQUAL(tables->NN, 1024);
+
+    //the table driven chirp matches genChirp() for every kind of chirp,
+    //compared without oversampling where the frequency wrap is exact in both
+    tables = getChirpTables(9, 1);
+    const size_t N = tables->N, ovs = tables->ovs, NN = tables->NN;
+    for (const size_t sym : {0, 1, 77, 511})
+    {
+        for (const bool down : {false, true})
+        {
+            std::cout << "testing chirp tables on symbol = " << sym << " down = " << down << std::endl;
+            std::vector<std::complex<float>> expected(NN), actual(NN);
+            float expectedPhase = M_PI/3, actualPhase = M_PI/3;
+            genChirp(expected.data(), N, ovs, NN, float(2*M_PI*sym)/NN, down, 0.5f, expectedPhase);
+            POTHOS_TEST_EQUAL(tables->genChirp(actual.data(), sym*ovs, NN, down, 0.5f, actualPhase), NN);
+            POTHOS_TEST_CLOSE(std::remainder(expectedPhase - actualPhase, float(2*M_PI)), 0.0f, 1e-2);
+            for (size_t i = 0; i < NN; i++)
+            {
+                POTHOS_TEST_CLOSE(std::abs(expected[i] - actual[i]), 0.0f, 1e-2);
+            }
+        }
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_fft_backends)
+{
+    for (size_t log2N = 7; log2N <= 12; log2N++)
+    {
+        const size_t N = size_t(1) << log2N;
+        FFTBuffer<float> input(N), expected(N), actual(N);
+        for (size_t i = 0; i < N; i++) input.data()[i] = std::complex<float>(std::rand(), std::rand())/float(RAND_MAX);
+        LoRaFFTKiss<float>(N).transform(input.data(), expected.data());
+
+        //every backend in this build agrees with kissfft and is shared per size
+        for (const auto &backend : getFFTBackends())
+        {
+            auto fft = getLoRaFFT<float>(backend, N);
+            POTHOS_TEST_TRUE(fft == getLoRaFFT<float>(backend, N));
+            fft->transform(input.data(), actual.data());
+            for (size_t i = 0; i < N; i++)
+            {
+                POTHOS_TEST_CLOSE(std::abs(expected.data()[i] - actual.data()[i]), 0.0f, 1e-3*std::sqrt(N));
+            }
+
+            //a batch transforms each symbol exactly like a single call
+            FFTBuffer<float> batchInput(2*N), batchOutput(2*N);
+            std::copy(input.data(), input.data() + N, batchInput.data() + N);
+            fft->transformBatch(batchInput.data(), batchOutput.data(), 2);
+            for (size_t i = 0; i < N; i++) POTHOS_TEST_EQUAL(batchOutput.data()[N+i], actual.data()[i]);
+
+            const size_t iters = (1 << 20)/N;
+            const auto t0 = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < iters; i++) fft->transform(input.data(), actual.data());
+            const auto t1 = std::chrono::high_resolution_clock::now();
+            std::cout << "fft backend " << backend << " N = " << N << ": "
+                << std::chrono::duration<double, std::micro>(t1 - t0).count()/iters << " us" << std::endl;
+        }
+        POTHOS_TEST_TRUE(getLoRaFFT<float>("auto", N) == getLoRaFFT<float>(getFFTBackends().front(), N));
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_detector_batch)
+{
+    const size_t N = 1 << 7;
+    const size_t K = 16;
+    float phaseAccum = 0.0f;
+    std::vector<std::complex<float>> downChirp(N), symbol(N);
+    genChirp(downChirp.data(), N, 1, N, 0.0f, true, 1.0f, phaseAccum);
+
+    //a batch finds the same symbols as one detect() per symbol
+    for (const auto &backend : getFFTBackends())
+    {
+        LoRaDetector<float> single(N, backend), batch(N, backend, K);
+        POTHOS_TEST_EQUAL(single.batchSize(), 1);
+        POTHOS_TEST_EQUAL(batch.batchSize(), K);
+        for (size_t k = 0; k < K; k++)
+        {
+            phaseAccum = 0.0f;
+            genChirp(symbol.data(), N, 1, N, float(2*M_PI*(k*7+3))/N, false, 1.0f, phaseAccum);
+            for (size_t i = 0; i < N; i++) batch.fftInput(k)[i] = downChirp[i]*symbol[i];
+        }
+        batch.transformBatch(K);
+        for (size_t k = 0; k < K; k++)
+        {
+            std::copy(batch.fftInput(k), batch.fftInput(k) + N, single.fftInput());
+            float power, powerAvg, fIndex, batchPower, batchPowerAvg, batchIndex;
+            const size_t value = single.detect(power, powerAvg, fIndex);
+            POTHOS_TEST_EQUAL(batch.detectBatch(k, batchPower, batchPowerAvg, batchIndex), value);
+            POTHOS_TEST_EQUAL(value, k*7+3);
+            POTHOS_TEST_CLOSE(batchPower, power, 0.01);
+            POTHOS_TEST_CLOSE(batchIndex, fIndex, 0.01);
+        }
+
+        const size_t iters = (1 << 20)/(N*K);
+        float power, powerAvg, fIndex;
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < iters; i++)
+        {
+            for (size_t k = 0; k < K; k++) single.detect(power, powerAvg, fIndex);
+        }
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < iters; i++)
+        {
+            batch.transformBatch(K);
+            for (size_t k = 0; k < K; k++) batch.detectBatch(k, power, powerAvg, fIndex);
+        }
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        std::cout << "detector " << backend << " N = " << N << ": "
+            << std::chrono::duration<double, std::nano>(t1 - t0).count()/(iters*K) << " ns single, "
+            << std::chrono::duration<double, std::nano>(t2 - t1).count()/(iters*K) << " ns batched" << std::endl;
+    }
+}
@@ -0,0 +1,168 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Testing.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Proxy.hpp>
+#include <Poco/TemporaryFile.h>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <json.hpp>
+
+using json = nlohmann::json;
+
+POTHOS_TEST_BLOCK("/lora/tests", test_iq_file_loopback)
+{
+    auto env = Pothos::ProxyEnvironment::make("managed");
+    auto registry = env->findProxy("Pothos/BlockRegistry");
+
+    //record random complex int16 samples with labels into a SigMF recording
+    const auto basePath = Poco::TemporaryFile::tempName();
+    const size_t numSamps = 100000;
+    Pothos::BufferChunk samps(typeid(std::complex<int16_t>), numSamps);
+    for (size_t n = 0; n < numSamps*2; n++)
+    {
+        samps.as<int16_t *>()[n] = int16_t(std::rand());
+    }
+    std::vector<Pothos::Label> labels;
+    labels.push_back(Pothos::Label("SYNC", Pothos::Object(), 10));
+    labels.push_back(Pothos::Label("DC", Pothos::Object(), 70000));
+
+    auto feeder = registry.call("/blocks/feeder_source", "complex_int16");
+    auto sink = registry.call("/lora/iq_file_sink", "complex_int16");
+    sink.call("setFilePath", basePath + ".sigmf-data");
+    sink.call("setSampleRate", 1e6);
+    feeder.call("feedBuffer", samps);
+    feeder.call("feedLabels", labels);
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, sink, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //replay the recording in small zero-copy chunks
+    auto source = registry.call("/lora/iq_file_source", "complex_int16");
+    auto collector = registry.call("/blocks/collector_sink", "complex_int16");
+    source.call("setFilePath", basePath + ".sigmf-meta");
+    source.call("setChunkSize", 4096);
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+    POTHOS_TEST_EQUAL(source.call<double>("getFileSampleRate"), 1e6);
+
+    const auto buffer = collector.call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(buffer.elements(), numSamps);
+    POTHOS_TEST_EQUALA(buffer.as<const int16_t *>(), samps.as<const int16_t *>(), numSamps*2);
+    const auto replayed = collector.call<std::vector<Pothos::Label>>("getLabels");
+    POTHOS_TEST_EQUAL(replayed.size(), labels.size());
+    for (size_t i = 0; i < labels.size(); i++)
+    {
+        POTHOS_TEST_EQUAL(replayed[i].id, labels[i].id);
+        POTHOS_TEST_EQUAL(replayed[i].index, labels[i].index);
+    }
+
+    //replay it again converted to float
+    auto floatSource = registry.call("/lora/iq_file_source", "complex_float32");
+    auto floatCollector = registry.call("/blocks/collector_sink", "complex_float32");
+    floatSource.call("setFilePath", basePath + ".sigmf-data");
+    {
+        Pothos::Topology topology;
+        topology.connect(floatSource, 0, floatCollector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+    const auto floats = floatCollector.call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(floats.elements(), numSamps);
+    for (size_t n = 0; n < numSamps*2; n++)
+    {
+        POTHOS_TEST_EQUAL(floats.as<const float *>()[n], samps.as<const int16_t *>()[n]/32768.0f);
+    }
+
+    std::remove((basePath + ".sigmf-data").c_str());
+    std::remove((basePath + ".sigmf-meta").c_str());
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_demod_capture)
+{
+    auto env = Pothos::ProxyEnvironment::make("managed");
+    auto registry = env->findProxy("Pothos/BlockRegistry");
+
+    //capture 100 ms around the sync of one packet
+    const size_t SF = 8;
+    const auto basePath = Poco::TemporaryFile::tempName();
+    auto feeder = registry.call("/blocks/feeder_source", "uint8");
+    auto encoder = registry.call("/lora/lora_encoder");
+    auto mod = registry.call("/lora/lora_mod", SF);
+    auto demod = registry.call("/lora/lora_demod", SF);
+    auto decoder = registry.call("/lora/lora_decoder");
+    auto collector = registry.call("/blocks/collector_sink", "uint8");
+    encoder.call("setSpreadFactor", SF);
+    decoder.call("setSpreadFactor", SF);
+    mod.call("setPadding", 512);
+    demod.call("setMTU", 512);
+    demod.call("setCapturePath", basePath);
+    demod.call("setCaptureTime", 0.1);
+    demod.call("setCaptureRate", 1e6);
+
+    json testPlan;
+    testPlan["enablePackets"] = true;
+    testPlan["minValue"] = 0;
+    testPlan["maxValue"] = 255;
+    testPlan["minBuffers"] = 1;
+    testPlan["maxBuffers"] = 1;
+    testPlan["minBufferSize"] = 8;
+    testPlan["maxBufferSize"] = 16;
+    auto expected = feeder.call("feedTestPlan", testPlan.dump());
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, encoder, 0);
+        topology.connect(encoder, 0, mod, 0);
+        topology.connect(mod, 0, demod, 0);
+        topology.connect(demod, 0, decoder, 0);
+        topology.connect(decoder, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.1, 0));
+    }
+    collector.call("verifyTestPlan", expected);
+
+    //the recording holds the packet and its labels
+    std::ifstream metaFile(basePath + "_0.sigmf-meta");
+    POTHOS_TEST_TRUE(metaFile);
+    json meta;
+    metaFile >> meta;
+    std::cout << meta.dump() << std::endl;
+    std::vector<std::string> labels;
+    for (const auto &annotation : meta["annotations"]) labels.push_back(annotation["core:label"].get<std::string>());
+    POTHOS_TEST_TRUE(std::find(labels.begin(), labels.end(), "SYNC") != labels.end());
+    POTHOS_TEST_TRUE(std::find(labels.begin(), labels.end(), "END") != labels.end());
+
+    //replaying the recording decodes the same packet
+    auto source = registry.call("/lora/iq_file_source", "complex_float32");
+    auto replayDemod = registry.call("/lora/lora_demod", SF);
+    auto replayDecoder = registry.call("/lora/lora_decoder");
+    auto replayCollector = registry.call("/blocks/collector_sink", "uint8");
+    source.call("setFilePath", basePath + "_0.sigmf-meta");
+    replayDecoder.call("setSpreadFactor", SF);
+    replayDemod.call("setMTU", 512);
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, replayDemod, 0);
+        topology.connect(replayDemod, 0, replayDecoder, 0);
+        topology.connect(replayDecoder, 0, replayCollector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.1, 0));
+    }
+    replayCollector.call("verifyTestPlan", expected);
+
+    std::remove((basePath + "_0.sigmf-data").c_str());
+    std::remove((basePath + "_0.sigmf-meta").c_str());
+}
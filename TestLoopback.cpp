@@ -6,6 +6,9 @@
 #include <Pothos/Proxy.hpp>
 #include <Pothos/Remote.hpp>
 #include <iostream>
+#include <algorithm>
+#include <complex>
+#include <cstring>
 #include "LoRaCodes.hpp"
 #include <json.hpp>
 
@@ -127,7 +130,230 @@ POTHOS_TEST_BLOCK("/lora/tests", test_loopback)
         }
 
         std::cout << "decoder dropped " << decoder.call<unsigned long long>("getDropped") << std::endl;
+
+        //the counters agree along the chain
+        const auto encoderStats = json::parse(encoder.call<std::string>("getStats"));
+        const auto modStats = json::parse(mod.call<std::string>("getStats"));
+        const auto demodStats = json::parse(demod.call<std::string>("getStats"));
+        const auto decoderStats = json::parse(decoder.call<std::string>("getStats"));
+        std::cout << "demod stats " << demodStats.dump() << std::endl;
+        std::cout << "decoder stats " << decoderStats.dump() << std::endl;
+        POTHOS_TEST_EQUAL(encoderStats["packets"].get<unsigned long long>(), 5);
+        POTHOS_TEST_EQUAL(modStats["packets"].get<unsigned long long>(), 5);
+        POTHOS_TEST_EQUAL(modStats["symbols"].get<unsigned long long>(), encoderStats["symbols"].get<unsigned long long>());
+        POTHOS_TEST_EQUAL(demodStats["packets"].get<unsigned long long>(), decoderStats["packets"].get<unsigned long long>());
+        POTHOS_TEST_EQUAL(decoderStats["dropped"].get<unsigned long long>(), decoder.call<unsigned long long>("getDropped"));
+        POTHOS_TEST_TRUE(demodStats["chunkAllocs"].get<unsigned long long>() <= demodStats["packets"].get<unsigned long long>());
+
         std::cout << "verifyTestPlan" << std::endl;
         collector.call("verifyTestPlan", expected);
     }
 }
+
+POTHOS_TEST_BLOCK("/lora/tests", test_loopback_multi_sf)
+{
+    auto env = Pothos::ProxyEnvironment::make("managed");
+    auto registry = env->findProxy("Pothos/BlockRegistry");
+
+    //the demod listens on SF8 and SF10, the packets are sent on SF10
+    const size_t SF = 10;
+    auto feeder = registry.call("/blocks/feeder_source", "uint8");
+    auto encoder = registry.call("/lora/lora_encoder");
+    auto mod = registry.call("/lora/lora_mod", SF);
+    auto adder = registry.call("/comms/arithmetic", "complex_float32", "ADD");
+    auto noise = registry.call("/comms/noise_source", "complex_float32");
+    auto demod = registry.call("/lora/lora_demod", 8);
+    auto decoder = registry.call("/lora/lora_decoder");
+    auto collector = registry.call("/blocks/collector_sink", "uint8");
+
+    //the decoder uses the spread factor from the packet metadata
+    encoder.call("setSpreadFactor", SF);
+    decoder.call("setSpreadFactor", 8);
+    decoder.call("enableCrcc", true);
+    demod.call("setSpreadFactors", std::vector<size_t>(1, SF));
+    mod.call("setAmplitude", 1.0);
+    noise.call("setAmplitude", 4.0);
+    noise.call("setWaveform", "NORMAL");
+    mod.call("setPadding", 512);
+    demod.call("setMTU", 512);
+
+    //create a test plan
+    json testPlan;
+    testPlan["enablePackets"] = true;
+    testPlan["minValue"] = 0;
+    testPlan["maxValue"] = 255;
+    testPlan["minBuffers"] = 5;
+    testPlan["maxBuffers"] = 5;
+    testPlan["minBufferSize"] = 8;
+    testPlan["maxBufferSize"] = 128;
+    auto expected = feeder.call("feedTestPlan", testPlan.dump());
+
+    //create tester topology
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, encoder, 0);
+        topology.connect(encoder, 0, mod, 0);
+        topology.connect(mod, 0, adder, 0);
+        topology.connect(noise, 0, adder, 1);
+        topology.connect(adder, 0, demod, 0);
+        topology.connect(demod, 0, decoder, 0);
+        topology.connect(decoder, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.1, 0));
+    }
+
+    std::cout << "decoder dropped " << decoder.call<unsigned long long>("getDropped") << std::endl;
+    std::cout << "verifyTestPlan" << std::endl;
+    collector.call("verifyTestPlan", expected);
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_loopback_ovs)
+{
+    auto env = Pothos::ProxyEnvironment::make("managed");
+    auto registry = env->findProxy("Pothos/BlockRegistry");
+
+    //the mod and demod run at 4 samples per chip
+    const size_t SF = 10;
+    const size_t OVS = 4;
+    auto feeder = registry.call("/blocks/feeder_source", "uint8");
+    auto encoder = registry.call("/lora/lora_encoder");
+    auto mod = registry.call("/lora/lora_mod", SF);
+    auto adder = registry.call("/comms/arithmetic", "complex_float32", "ADD");
+    auto noise = registry.call("/comms/noise_source", "complex_float32");
+    auto demod = registry.call("/lora/lora_demod", SF);
+    auto decoder = registry.call("/lora/lora_decoder");
+    auto collector = registry.call("/blocks/collector_sink", "uint8");
+
+    encoder.call("setSpreadFactor", SF);
+    decoder.call("setSpreadFactor", SF);
+    mod.call("setOvs", OVS);
+    demod.call("setOvs", OVS);
+    mod.call("setAmplitude", 1.0);
+    noise.call("setAmplitude", 4.0);
+    noise.call("setWaveform", "NORMAL");
+    mod.call("setPadding", 512);
+    demod.call("setMTU", 512);
+
+    //create a test plan
+    json testPlan;
+    testPlan["enablePackets"] = true;
+    testPlan["minValue"] = 0;
+    testPlan["maxValue"] = 255;
+    testPlan["minBuffers"] = 5;
+    testPlan["maxBuffers"] = 5;
+    testPlan["minBufferSize"] = 8;
+    testPlan["maxBufferSize"] = 128;
+    auto expected = feeder.call("feedTestPlan", testPlan.dump());
+
+    //create tester topology
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, encoder, 0);
+        topology.connect(encoder, 0, mod, 0);
+        topology.connect(mod, 0, adder, 0);
+        topology.connect(noise, 0, adder, 1);
+        topology.connect(adder, 0, demod, 0);
+        topology.connect(demod, 0, decoder, 0);
+        topology.connect(decoder, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.1, 0));
+    }
+
+    std::cout << "decoder dropped " << decoder.call<unsigned long long>("getDropped") << std::endl;
+    std::cout << "verifyTestPlan" << std::endl;
+    collector.call("verifyTestPlan", expected);
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_loopback_collision)
+{
+    auto env = Pothos::ProxyEnvironment::make("managed");
+    auto registry = env->findProxy("Pothos/BlockRegistry");
+
+    //two packets of equal power and no frequency offset,
+    //the second starts during the payload of the first
+    const size_t SF = 8;
+    const size_t N = size_t(1) << SF;
+    const size_t stagger = 60*N + 85;
+    std::vector<std::string> payloads;
+    payloads.push_back("hello world packet 0");
+    payloads.push_back("hello world packet 7919");
+
+    //modulate each packet on its own
+    std::vector<Pothos::BufferChunk> waveforms;
+    for (const auto &payload : payloads)
+    {
+        auto feeder = registry.call("/blocks/feeder_source", "uint8");
+        auto encoder = registry.call("/lora/lora_encoder");
+        auto mod = registry.call("/lora/lora_mod", SF);
+        auto collector = registry.call("/blocks/collector_sink", "complex_float32");
+
+        encoder.call("setSpreadFactor", SF);
+        encoder.call("setCodingRate", "4/8");
+        mod.call("setAmplitude", 1.0);
+        mod.call("setPadding", 64);
+
+        Pothos::Packet packet;
+        packet.payload = Pothos::BufferChunk(typeid(uint8_t), payload.size());
+        std::memcpy(packet.payload.as<void *>(), payload.data(), payload.size());
+        feeder.call("feedPacket", packet);
+
+        {
+            Pothos::Topology topology;
+            topology.connect(feeder, 0, encoder, 0);
+            topology.connect(encoder, 0, mod, 0);
+            topology.connect(mod, 0, collector, 0);
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive());
+        }
+        waveforms.push_back(collector.call<Pothos::BufferChunk>("getBuffer"));
+    }
+
+    //sum both packets with some silence around them
+    const size_t start = 20*N;
+    const size_t total = start + stagger + waveforms[1].elements() + 20*N;
+    POTHOS_TEST_TRUE(waveforms[0].elements() > stagger);
+    Pothos::BufferChunk samples(typeid(std::complex<float>), total);
+    auto out = samples.as<std::complex<float> *>();
+    std::fill(out, out + total, std::complex<float>(0.0f, 0.0f));
+    for (size_t i = 0; i < waveforms[0].elements(); i++) out[start+i] += waveforms[0].as<const std::complex<float> *>()[i];
+    for (size_t i = 0; i < waveforms[1].elements(); i++) out[start+stagger+i] += waveforms[1].as<const std::complex<float> *>()[i];
+
+    auto feeder = registry.call("/blocks/feeder_source", "complex_float32");
+    auto adder = registry.call("/comms/arithmetic", "complex_float32", "ADD");
+    auto noise = registry.call("/comms/noise_source", "complex_float32");
+    auto demod = registry.call("/lora/lora_demod", SF);
+    auto decoder = registry.call("/lora/lora_decoder");
+    auto collector = registry.call("/blocks/collector_sink", "uint8");
+
+    decoder.call("setSpreadFactor", SF);
+    decoder.call("setCodingRate", "4/8");
+    decoder.call("enableCrcc", true);
+    noise.call("setAmplitude", 0.3);
+    noise.call("setWaveform", "NORMAL");
+    demod.call("setPacketContexts", 2);
+    demod.call("setMTU", 512);
+    feeder.call("feedBuffer", samples);
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, adder, 0);
+        topology.connect(noise, 0, adder, 1);
+        topology.connect(adder, 0, demod, 0);
+        topology.connect(demod, 0, decoder, 0);
+        topology.connect(decoder, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.1, 0));
+    }
+
+    //both packets decode, not just the stronger or earlier one
+    std::vector<std::string> decoded;
+    for (const auto &packet : collector.call<std::vector<Pothos::Packet>>("getPackets"))
+    {
+        decoded.emplace_back(packet.payload.as<const char *>(), packet.payload.length);
+        std::cout << "decoded " << decoded.back() << std::endl;
+    }
+    for (const auto &payload : payloads)
+    {
+        POTHOS_TEST_TRUE(std::find(decoded.begin(), decoded.end(), payload) != decoded.end());
+    }
+}